@@ -0,0 +1,167 @@
+/* bench.c - MemTest-86  Version 4.1
+ *
+ * Micro-benchmarks for the test kernels, run with the "bench" option at
+ * startup or in the Linux build.  Each kernel is run once over buffers
+ * of fixed sizes with one CPU and then with all of them.  The speed comes
+ * from the bytes the kernels count in cpu_acct[], one line per run:
+ *
+ *   bench  movinv1    4096    2   12.34    0.289
+ *
+ * is the kernel, KB, CPUs, GB/s and clocks per byte.  The lines do not
+ * change form between builds so that two logs can be compared with diff.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "smp.h"
+
+extern volatile int mstr_cpu;
+extern volatile int run_cpus;
+extern volatile int segs, bail;
+
+#define BK_ADDR		0
+#define BK_MOVINV1	1
+#define BK_MOVINVR	2
+#define BK_MOVINV32	3
+#define BK_MODTST	4
+#define BK_BLKMOVE	5
+#define BK_FADEFILL	6
+#define BK_FADECHK	7	/* Checks what BK_FADEFILL wrote */
+#define BK_MAX		8
+
+static char *bench_names[BK_MAX] = {
+	"addr", "movinv1", "movinvr", "movinv32", "modtst", "blkmove",
+	"fadefill", "fadechk"
+};
+
+/* Buffer sizes in KB, the ones that don't fit are skipped */
+static ulong bench_kb[] = { 256, 4096, 16384 };
+
+static void bench_kernel(int k, int me)
+{
+	switch (k) {
+	case BK_ADDR:
+		addr_tst2(me, 1);
+		break;
+	case BK_MOVINV1:
+		movinv1(1, 0, ~0, 0, 0, me);
+		break;
+	case BK_MOVINVR:
+		movinvr(me);
+		break;
+	case BK_MOVINV32:
+		movinv32(1, 1, 1, 0x80000000, 0, 0, me);
+		break;
+	case BK_MODTST:
+		modtst(0, 2, 0x55555555, 0xaaaaaaaa, me);
+		break;
+	case BK_BLKMOVE:
+		block_move(1, me);
+		break;
+	case BK_FADEFILL:
+		bit_fade_fill(0, me);
+		break;
+	case BK_FADECHK:
+		bit_fade_chk(0, me);
+		break;
+	}
+}
+
+/* Print val / 10^d with d decimals, right aligned in w columns */
+static void bench_fix(int y, int x, ulong val, int d, int w)
+{
+	ulong p;
+	int i;
+
+	for (i = 0, p = 1; i < d; i++) {
+		p *= 10;
+	}
+	dprint(y, x, val / p, w - d - 1, 0);
+	cprint(y, x + w - d - 1, ".");
+	for (i = d; i > 0; i--) {
+		p /= 10;
+		dprint(y, x + w - i, val / p % 10, 1, 0);
+	}
+}
+
+static void bench_show(int k, ulong kb, int n, uint64_t clks)
+{
+	uint64_t bytes = 0;
+	int i, y;
+
+	for (i = 0; i < n; i++) {
+		bytes += cpu_acct[i].rd + cpu_acct[i].wr;
+		cpu_acct[i].rd = 0;
+		cpu_acct[i].wr = 0;
+	}
+	if ((y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "bench");
+	cprint(y, 7, bench_names[k]);
+	dprint(y, 16, kb, 6, 0);
+	dprint(y, 23, n, 4, 0);
+	if (bytes == 0 || clks == 0) {
+		return;
+	}
+	/* Bytes per msec / 10^4 is GB/s * 100 */
+	bench_fix(y, 28, udiv64(udiv64(bytes * v->clks_msec, clks),
+		10000), 2, 7);
+	bench_fix(y, 36, udiv64(clks * 1000, bytes), 3, 8);
+}
+
+/*
+ * Run the benchmarks in the len bytes at start.  Called by all n CPUs,
+ * CPU 0 sets up each run and times it between two barriers.
+ */
+void bench_run(int me, int n, ulong start, ulong len)
+{
+	uint64_t t = 0;
+	int c, s, k, y;
+
+	if (v->clks_msec == 0 || v->clks_msec == -1) {
+		return;
+	}
+	if (me == 0 && (y = report_line()) >= 0) {
+		cprint(y, 0,
+			"bench  kernel       KB CPUs    GB/s    clk/B");
+	}
+	for (c = 1; ; c = n) {
+		for (s = 0; s < sizeof(bench_kb) / sizeof(bench_kb[0]); s++) {
+			if (bench_kb[s] * 1024 > len) {
+				break;
+			}
+			for (k = 0; k < BK_MAX; k++) {
+				if (me == 0) {
+					v->map[0].start = (ulong *)start;
+					v->map[0].end = (ulong *)(start +
+						bench_kb[s] * 1024) - 1;
+					segs = 1;
+					mstr_cpu = 0;
+					run_cpus = c;
+					s_barrier_init(c);
+				}
+				barrier();
+				if (me == 0) {
+					t = get_tsc();
+				}
+				if (me < c) {
+					bench_kernel(k, me);
+				}
+				barrier();
+				if (bail) {
+					return;
+				}
+				if (me == 0) {
+					bench_show(k, bench_kb[s], c,
+						get_tsc() - t);
+				}
+			}
+		}
+		if (c >= n) {
+			break;
+		}
+	}
+}
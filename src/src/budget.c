@@ -0,0 +1,280 @@
+/* budget.c - MemTest-86  Version 4.1
+ *
+ * Fit the tests into a fixed amount of time.  The tests, their iteration
+ * counts and their order are chosen to find the most errors per minute,
+ * using the measured speed of each test and the errors found so far.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+
+extern struct tseq tseq[];
+extern volatile int test;
+extern int budget_min;
+extern void find_ticks_for_pass(void);
+
+/* Relative chance of one iteration of each pattern finding a defect */
+static const unsigned char pat_yield[] = {
+	2,	/* 0  Address test, walking ones */
+	3,	/* 1  Address test, own address */
+	3,	/* 2  Address test, own address, parallel */
+	4,	/* 3  Moving inversions, ones & zeros */
+	4,	/* 4  Moving inversions, ones & zeros */
+	6,	/* 5  Moving inversions, 8 bit pattern */
+	8,	/* 6  Moving inversions, random pattern */
+	7,	/* 7  Block move */
+	6,	/* 8  Moving inversions, 32 bit pattern */
+	7,	/* 9  Random number sequence */
+	5,	/* 10 Modulo 20, random pattern */
+	4,	/* 11 Bit fade */
+	5,	/* 12 Row hammer */
+	6,	/* 13 Stress */
+	4,	/* 14 Cross CPU write and check */
+};
+
+/* Tests that have already found errors are weighted this much more */
+#define ERR_BOOST	8
+
+static int bud_iter[MAX_TESTS];		/* Iterations planned for each test */
+static int bud_order[MAX_TESTS];	/* Tests left to run in this pass */
+static int bud_cnt;
+static char bud_done[MAX_TESTS];	/* Test has run in this pass */
+static ulong bud_ttfe[MAX_TESTS];	/* Msec into the test to the first
+					 * error, 0 if there were none */
+static uint64_t bud_tsc;		/* Start of the run */
+static int bud_over;
+
+/* Msec left in the budget */
+ulong budget_left(void)
+{
+	ulong used;
+
+	if (bud_over) {
+		return 0;
+	}
+	used = udiv64(get_tsc() - bud_tsc, v->clks_msec);
+	if (used >= budget_min * 60000) {
+		return 0;
+	}
+	return budget_min * 60000 - used;
+}
+
+/* Iterations are handed out in steps, the bit fade needs a long sleep */
+static int budget_step(int t)
+{
+	if (tseq[t].pat == 11 && tseq[t].iter >= 3) {
+		return tseq[t].iter / 3;
+	}
+	return 1;
+}
+
+static ulong budget_weight(int t)
+{
+	ulong w = 1;
+
+	if (tseq[t].pat < sizeof(pat_yield)) {
+		w = pat_yield[tseq[t].pat];
+	}
+	if (tseq[t].errors) {
+		w *= ERR_BOOST;
+	}
+	return w;
+}
+
+/*
+ * Plan the tests that have not run yet in this pass.  Iterations are
+ * handed out one step at a time to the test that finds the most for
+ * the time it takes and still fits in the time left.  Each step is
+ * assumed to yield less than the one before it.
+ */
+static void budget_plan(void)
+{
+	ulong left, used, t0, t1, d, best_d, best_ms, key[MAX_TESTS];
+	int i, j, best, step;
+
+	left = budget_left();
+	for (i = 0; i < MAX_TESTS; i++) {
+		bud_iter[i] = 0;
+	}
+	for (used = 0; ; used += best_ms) {
+		best = -1;
+		best_d = best_ms = 0;
+		for (i = 0; tseq[i].cpu_sel != 0 && i < MAX_TESTS; i++) {
+			if (tseq[i].sel == 0 || bud_done[i]) {
+				continue;
+			}
+			step = budget_step(i);
+			if (bud_iter[i] + step > tseq[i].iter) {
+				continue;
+			}
+			t0 = bud_iter[i] ? stat_est_ms(i, bud_iter[i]) : 0;
+			t1 = stat_est_ms(i, bud_iter[i] + step);
+			if (t1 < t0 || used + t1 - t0 > left) {
+				continue;
+			}
+			d = (budget_weight(i) << 20) / (bud_iter[i] / step + 1);
+			d /= t1 - t0 + 1;
+			if (best < 0 || d > best_d) {
+				best = i;
+				best_d = d;
+				best_ms = t1 - t0;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		bud_iter[best] += budget_step(best);
+	}
+
+	/* Tests that found errors go first, the quickest to fail leading,
+	 * then the rest in order of yield for the time they take */
+	bud_cnt = 0;
+	for (i = 0; tseq[i].cpu_sel != 0 && i < MAX_TESTS; i++) {
+		if (bud_iter[i] == 0) {
+			continue;
+		}
+		if (bud_ttfe[i]) {
+			key[i] = ~0UL - bud_ttfe[i];
+		} else {
+			key[i] = (budget_weight(i) << 20) /
+				(stat_est_ms(i, bud_iter[i]) + 1);
+		}
+		for (j = bud_cnt; j > 0 && key[bud_order[j-1]] < key[i]; j--) {
+			bud_order[j] = bud_order[j-1];
+		}
+		bud_order[j] = i;
+		bud_cnt++;
+	}
+}
+
+/*
+ * Start the run with a plan for the first pass
+ */
+void budget_start(void)
+{
+	int i;
+
+	if (budget_min == 0) {
+		return;
+	}
+	if (!cpu_id.fid.bits.rdtsc) {
+		budget_min = 0;
+		return;
+	}
+	bud_tsc = get_tsc();
+	for (i = 0; i < MAX_TESTS; i++) {
+		bud_ttfe[i] = 0;
+	}
+	if ((i = budget_pass()) < 0) {
+		/* Not even one test fits, run the normal sequence */
+		budget_min = 0;
+		find_ticks_for_pass();
+		return;
+	}
+	test = i;
+	find_ticks_for_pass();
+	budget_report();
+}
+
+/*
+ * Plan a new pass with the time that is left.  Returns the first test
+ * or -1 when the budget is used up.
+ */
+int budget_pass(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_TESTS; i++) {
+		bud_done[i] = 0;
+	}
+	if (budget_left() > 0) {
+		budget_plan();
+	} else {
+		bud_cnt = 0;
+	}
+	if (bud_cnt == 0) {
+		bud_over = 1;
+		return -1;
+	}
+	return bud_order[0];
+}
+
+/*
+ * The current test is done, re-plan the rest of the pass with what we
+ * measured and return the next test or -1 at the end of the pass.
+ */
+int budget_next(void)
+{
+	if (test >= 0 && test < MAX_TESTS) {
+		bud_done[test] = 1;
+	}
+	budget_plan();
+	if (bud_cnt == 0) {
+		return -1;
+	}
+	return bud_order[0];
+}
+
+/* The test that runs after tst in the plan, -1 if there is none */
+int budget_after(int tst)
+{
+	int i;
+
+	for (i = 0; i < bud_cnt - 1; i++) {
+		if (bud_order[i] == tst) {
+			return bud_order[i+1];
+		}
+	}
+	return -1;
+}
+
+int budget_iter(int tst)
+{
+	return bud_iter[tst];
+}
+
+int budget_over(void)
+{
+	return bud_over;
+}
+
+/* Remember how long the current test took to find its first error */
+void budget_err(void)
+{
+	if (budget_min && test < MAX_TESTS && bud_ttfe[test] == 0) {
+		bud_ttfe[test] = stat_test_ms() + 1;
+	}
+}
+
+/*
+ * Display the time left and the plan for this pass
+ */
+void budget_report(void)
+{
+	int i, x, y;
+
+	if (budget_min == 0 || (y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "Time budget:      min, left:      min, plan:");
+	dprint(y, 13, budget_min, 4, 0);
+	dprint(y, 28, budget_left() / 60000, 4, 0);
+	for (i = 0, x = 80; i < bud_cnt; i++) {
+		if (x > 80-16) {
+			if ((y = report_line()) < 0) {
+				break;
+			}
+			x = 0;
+		}
+		cprint(y, x, "#");
+		dprint(y, x+1, bud_order[i], 2, 0);
+		cprint(y, x+3, " x");
+		dprint(y, x+5, bud_iter[bud_order[i]], 3, 0);
+		dprint(y, x+8, stat_est_ms(bud_order[i],
+			bud_iter[bud_order[i]]) / 60000, 4, 0);
+		cprint(y, x+12, "m");
+		x += 16;
+	}
+}
@@ -83,12 +83,17 @@ void get_config()
 				case 4:
 					/* Select test */
 					popclear();
+					k = 0;
+					while (tseq[k].cpu_sel) {
+					    k++;
+					}
 					cprint(POP_Y+1, POP_X+3,
 						"Test Selection:");
 					cprint(POP_Y+4, POP_X+5,
-						"Test Number [0-10]: ");
+						"Test Number [0-  ]: ");
+					dprint(POP_Y+4, POP_X+20, k-1, 2, 0);
 					n = getval(POP_Y+4, POP_X+24, 0);
-					if (n <= 10) {
+					if (n >= 0 && n < k) {
 					    /* Deselect all tests */
 					    i = 0;
 					    while (tseq[i].cpu_sel) {
@@ -309,7 +314,9 @@ void get_config()
 			cprint(POP_Y+6, POP_X+6, "     Switch CPU after each test.");
 			cprint(POP_Y+7, POP_X+6, "(3) Sequential");
 			cprint(POP_Y+8, POP_X+6, "     Repeat each test on every CPU.");
-			cprint(POP_Y+9, POP_X+6, "(0) Cancel");
+			cprint(POP_Y+9, POP_X+6, "(4) Rotated");
+			cprint(POP_Y+10, POP_X+6, "     All CPUs, rotate the regions.");
+			cprint(POP_Y+11, POP_X+6, "(0) Cancel");
 			cprint(POP_Y+1+(cpu_mode*2), POP_X+5, ">");
 			wait_keyup();
 			while(!sflag) {
@@ -329,6 +336,11 @@ void get_config()
 					cpu_mode = CPM_SEQ;
 					sflag++;
 					break;
+				case 5:
+					if (cpu_mode != CPM_ROTATE) bail++;
+					cpu_mode = CPM_ROTATE;
+					sflag++;
+					break;
 				case 11:
 				case 57:
 					/* 0/CR - Continue */
@@ -575,4 +587,7 @@ void adj_mem(void)
 				(v->plim_upper - v->pmap[i].start);
 		}
 	}
+
+	/* The windows to test depend on the range */
+	compute_windows();
 }
@@ -27,6 +27,19 @@ void get_cpuid()
 		&cpu_id.fid.uint32_array[1], &cpu_id.fid.uint32_array[0]);
 	}
 
+	/* Get the structured extended feature flags, only save EBX and ECX */
+	if (cpu_id.max_cpuid >= 0x00000007) {
+	    cpuid_count(0x00000007, 0, &dummy[0], &cpu_id.fid7,
+		&cpu_id.fid7c, &dummy[1]);
+	}
+
+	/* Get the state components that XSAVE supports, only save EAX */
+	if (cpu_id.max_cpuid >= 0x0000000d &&
+			(cpu_id.fid.uint32_array[1] & CPUID1_XSAVE)) {
+	    cpuid_count(0x0000000d, 0, &cpu_id.xcr0_ok, &dummy[0],
+		&dummy[1], &dummy[2]);
+	}
+
 	btrace(0, __LINE__, "CpuID Ext ", 1, cpu_id.fid.uint32_array[0],
 		cpu_id.fid.uint32_array[1]);
 	/* Get the max extended cpuid */
@@ -157,8 +157,33 @@ struct cpu_ident {
 	cpuid_vendor_string_t vend_id;
 	cpuid_brand_string_t brand_id;
 	cpuid_cache_info_t cache_info;
+	uint32_t fid7;			/* Leaf 7 EBX feature flags */
+	uint32_t fid7c;			/* Leaf 7 ECX feature flags */
+	uint32_t xcr0_ok;		/* XCR0 bits the CPU supports */
 };
 
+/* Leaf 1 ECX feature flags, in fid.uint32_array[1] */
+#define CPUID1_SSE41		(1 << 19)
+#define CPUID1_SSE42		(1 << 20)
+#define CPUID1_XSAVE		(1 << 26)
+#define CPUID1_OSXSAVE		(1 << 27)
+#define CPUID1_AVX		(1 << 28)
+#define CPUID1_HYPERVISOR	(1 << 31)
+
+/* Leaf 7 EBX feature flags */
+#define CPUID7_AVX2		(1 << 5)
+#define CPUID7_ERMS		(1 << 9)
+#define CPUID7_AVX512F		(1 << 16)
+#define CPUID7_CLFLUSHOPT	(1 << 23)
+#define CPUID7_CLWB		(1 << 24)
+
+/* Leaf 7 ECX feature flags */
+#define CPUID7C_MOVDIR64B	(1 << 28)
+
+/* XCR0 state components */
+#define XCR0_AVX		0x06		/* SSE and AVX, x87 is always on */
+#define XCR0_AVX512		0xe0		/* Opmask and the ZMM registers */
+
 struct cpuid4_eax {
 	uint32_t	ctype:5;
 	uint32_t	level:3;
@@ -0,0 +1,258 @@
+/* dram.c - MemTest-86  Version 4.1
+ *
+ * Find how the memory controller maps physical addresses to DRAM banks by
+ * timing reads of two addresses that are flushed from the cache.  Two
+ * addresses in the same bank but in different rows are slow, each read
+ * has to close the row that the other one opened.  All of the addresses
+ * that are slow with one base address give the same value for every
+ * bank function, so the functions are the XORs of address bits that are
+ * the same for all of them.  The channel and rank are picked the same
+ * way and show up as more functions.
+ *
+ * The bits that are in no function but are still slow when flipped pick
+ * the row.  The row hammer test uses them to make pairs in one bank.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+
+#define DRAM_LOOPS	32	/* Reads to time a pair */
+#define DRAM_CAL	256	/* Pairs timed to set the threshold */
+#define DRAM_SET	48	/* Addresses wanted in the base bank */
+#define DRAM_TRIES	16384	/* Addresses tried to find them */
+#define DRAM_BITS	22	/* Most address bits searched */
+#define DRAM_MAXW	6	/* Most bits in one function */
+#define DRAM_MAXFN	8
+
+uint64_t dram_fn[DRAM_MAXFN];
+int dram_nfn;
+uint64_t dram_rows;		/* Address bits that only pick the row */
+
+/* Its own random numbers, so the sequences the tests use don't change */
+static ulong rnd_state = 0x2545f491;
+
+static ulong dram_rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/* Read a and b n times, flushing both each time.  Returns the clocks. */
+uint64_t dram_pair(volatile ulong *a, volatile ulong *b, ulong n)
+{
+	uint64_t t = get_tsc();
+
+	asm __volatile__ (
+		"1:\n\t"
+		"movl (%1),%%eax\n\t"
+		"movl (%2),%%eax\n\t"
+		"clflush (%1)\n\t"
+		"clflush (%2)\n\t"
+		"mfence\n\t"
+		"decl %0\n\t"
+		"jnz 1b\n\t"
+		: "+r" (n)
+		: "r" (a), "r" (b)
+		: "ax", "memory"
+	);
+	return get_tsc() - t;
+}
+
+/* The better of two timings, an interrupt can only make one slower */
+static uint64_t dram_time(ulong *a, ulong *b)
+{
+	uint64_t t0, t1;
+
+	t0 = dram_pair(a, b, DRAM_LOOPS);
+	t1 = dram_pair(a, b, DRAM_LOOPS);
+	return t0 < t1 ? t0 : t1;
+}
+
+static int parity(uint64_t x)
+{
+	ulong v = (ulong)x ^ (ulong)(x >> 32);
+
+	v ^= v >> 16;
+	v ^= v >> 8;
+	v ^= v >> 4;
+	v ^= v >> 2;
+	v ^= v >> 1;
+	return v & 1;
+}
+
+/* Add m to the functions unless it is an XOR of the ones found already */
+static int dram_indep(ulong m, ulong *piv)
+{
+	int k;
+
+	for (k = DRAM_BITS - 1; k >= 0; k--) {
+		if (!(m >> k & 1)) {
+			continue;
+		}
+		if (!piv[k]) {
+			piv[k] = m;
+			return 1;
+		}
+		m ^= piv[k];
+	}
+	return 0;
+}
+
+static void dram_show(int n)
+{
+	uint64_t all = 0;
+	int i, k, x, y;
+
+	for (i = 0; i < dram_nfn; i++) {
+		all |= dram_fn[i];
+	}
+	if ((y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "DRAM map:    functions from    addresses in one bank");
+	dprint(y, 10, dram_nfn, 2, 0);
+	dprint(y, 27, n, 3, 0);
+	if (dram_rows) {
+		for (k = 0; !(dram_rows >> k & 1); k++)
+			;
+		cprint(y, 54, "rows from bit");
+		dprint(y, 68, k, 2, 0);
+	}
+	for (i = 0; i < dram_nfn; i++) {
+		if ((y = report_line()) < 0) {
+			return;
+		}
+		cprint(y, 2, "bits");
+		for (k = 0, x = 7; k < 64; k++) {
+			if (dram_fn[i] >> k & 1) {
+				dprint(y, x, k, 2, 0);
+				x += 3;
+			}
+		}
+		/* Banks are picked above the columns of a row, a function
+		 * with a bit in the first 4 KB interleaves the channels */
+		if ((dram_fn[i] & 0xfff) != 0) {
+			cprint(y, x + 1, "channel");
+		}
+	}
+}
+
+/*
+ * Work out the bank functions and the row bits from the len bytes at
+ * start.  Called by one CPU with the others kept off the memory.
+ */
+void dram_find(ulong start, ulong len)
+{
+	static uint64_t t[DRAM_CAL], set[DRAM_SET];
+	static ulong c[DRAM_SET], piv[DRAM_BITS];
+	uint64_t pa, vary, thr, tt, fn;
+	ulong *a, *b, m, lo, r, next;
+	int i, j, k, n, w, nb, bit[DRAM_BITS], y;
+
+	dram_nfn = 0;
+	dram_rows = 0;
+	if (!addr_flush_ok() || v->clks_msec == -1 || len < 0x100000) {
+		return;
+	}
+	len &= ~63;
+	a = (ulong *)(start + len / 2);
+	pa = dram_phys(a);
+
+	/* Most random pairs are in different banks, the slowest ones show
+	 * how long a row conflict takes */
+	for (i = 0; i < DRAM_CAL; i++) {
+		b = (ulong *)(start + (dram_rnd() % (len / 64)) * 64);
+		tt = dram_time(a, b);
+		for (j = i; j > 0 && t[j - 1] > tt; j--) {
+			t[j] = t[j - 1];
+		}
+		t[j] = tt;
+	}
+	thr = t[DRAM_CAL / 2] + (t[DRAM_CAL - 1] - t[DRAM_CAL / 2]) / 2;
+	if (t[DRAM_CAL - 1] < t[DRAM_CAL / 2] + t[DRAM_CAL / 2] / 8) {
+		if ((y = report_line()) >= 0) {
+			cprint(y, 0, "DRAM map: no row conflicts seen");
+		}
+		return;
+	}
+
+	/* Addresses in the bank of a, checked twice against noise */
+	for (n = 0, i = 0; n < DRAM_SET && i < DRAM_TRIES; i++) {
+		b = (ulong *)(start + (dram_rnd() % (len / 64)) * 64);
+		if (dram_time(a, b) > thr && dram_time(a, b) > thr) {
+			set[n++] = dram_phys(b) ^ pa;
+		}
+	}
+	if (n < DRAM_SET / 2) {
+		if ((y = report_line()) >= 0) {
+			cprint(y, 0, "DRAM map: too few conflicts,    found");
+			dprint(y, 29, n, 3, 0);
+		}
+		return;
+	}
+
+	/* The bits that change in the set, above the cache line */
+	for (i = 0, vary = 0; i < n; i++) {
+		vary |= set[i];
+	}
+	for (k = 6, nb = 0; k < 64 && nb < DRAM_BITS; k++) {
+		if (vary >> k & 1) {
+			bit[nb++] = k;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		for (j = 0, c[i] = 0; j < nb; j++) {
+			c[i] |= (ulong)(set[i] >> bit[j] & 1) << j;
+		}
+	}
+
+	/* Every function has the same value for the whole set.  Try the
+	 * masks with the fewest bits first, each weight in turn. */
+	for (w = 1; w <= DRAM_MAXW && w <= nb; w++) {
+		for (m = (1UL << w) - 1; m < (1UL << nb); m = next) {
+			for (i = 0; i < n && !parity(c[i] & m); i++)
+				;
+			if (i == n && dram_nfn < DRAM_MAXFN &&
+					dram_indep(m, piv)) {
+				for (j = 0, fn = 0; j < nb; j++) {
+					if (m >> j & 1) {
+						fn |= 1ULL << bit[j];
+					}
+				}
+				dram_fn[dram_nfn++] = fn;
+			}
+			/* The next mask with w bits */
+			lo = m & -m;
+			r = m + lo;
+			next = (((r ^ m) >> 2) / lo) | r;
+		}
+	}
+
+	/* A bit in no function keeps the bank, it picks the row if
+	 * flipping it is slow */
+	for (i = 0, fn = 0; i < dram_nfn; i++) {
+		fn |= dram_fn[i];
+	}
+	for (j = 0; j < nb; j++) {
+		k = bit[j];
+		if (fn >> k & 1 || k >= 32) {
+			continue;
+		}
+		for (i = 0; i < 16; i++) {
+			a = (ulong *)(start + (dram_rnd() % (len / 64)) * 64);
+			b = (ulong *)((ulong)a ^ (1UL << k));
+			if (b >= (ulong *)start && b < (ulong *)(start + len) &&
+					dram_phys(b) == (dram_phys(a) ^
+					(1ULL << k))) {
+				break;
+			}
+		}
+		if (i < 16 && dram_time(a, b) > thr) {
+			dram_rows |= 1ULL << k;
+		}
+	}
+	dram_show(n);
+}
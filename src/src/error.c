@@ -23,6 +23,10 @@ static void common_err();
 static int syn, chan, len=1;
 
 #define MAX_ERRORS 0xFFFF
+#define SUM_ROWS (24 - LINE_HEADER - 1)	/* Test counts in a summary column */
+
+/* 1 + the CPU that wrote the memory each CPU is checking, 0 = itself */
+short err_writer[MAX_CPUS];
 
 /*
  * Display data error message. Don't display duplicate errors.
@@ -81,6 +85,8 @@ static void update_err_counts(void)
 	if (v->ecount < MAX_ERRORS)
 		++(v->ecount);
 
+	if (tseq[test].errors == 0)
+		budget_err();
 	if (tseq[test].errors < MAX_ERRORS)
 		tseq[test].errors++;
 		
@@ -117,7 +123,7 @@ static void print_err_counts(void)
  */
 void common_err( ulong *adr, ulong good, ulong bad, ulong xor, int type) 
 {
-	int i, n, flag=0;
+	int i, n, x, y, cpu, flag=0;
 	ulong page, offset;
 	int patnchg;
 	ulong mb;
@@ -128,11 +134,15 @@ void common_err( ulong *adr, ulong good, ulong bad, ulong xor, int type)
 	switch(v->printmode) {
 	case PRINTMODE_SUMMARY:
 		
+		/* The tests that don't fit above the footer go in a second
+		 * column to the left */
 		for (i=0; tseq[i].msg != NULL; i++) {
-			dprint(LINE_HEADER+1+i, 66, i, 2, 0);
-			dprint(LINE_HEADER+1+i, 69, tseq[i].errors, 6, 0);
+			y = LINE_HEADER+1 + i % SUM_ROWS;
+			x = i < SUM_ROWS ? 66 : 53;
+			dprint(y, x, i, 2, 0);
+			dprint(y, x+3, tseq[i].errors, 6, 0);
 			if (tseq[i].errors >= MAX_ERRORS)
-				cprint(LINE_HEADER+1+i, 75, "+");
+				cprint(y, x+9, "+");
 	  	}
 
 		/* Don't do anything for a parity error. */
@@ -235,6 +245,10 @@ void common_err( ulong *adr, ulong good, ulong bad, ulong xor, int type)
 			cprint(LINE_HEADER+5, 1,  " Max Contiguous Errors:");
 
 			cprint(LINE_HEADER+0, 64,   "Test  Errors");
+			for (i=0; tseq[i].msg != NULL; i++)
+				;
+			if (i > SUM_ROWS)
+				cprint(LINE_HEADER+0, 51, "Test  Errors");
 			v->erri.hdr_flag++;
 		}
 		if (flag) {
@@ -325,7 +339,15 @@ void common_err( ulong *adr, ulong good, ulong bad, ulong xor, int type)
 			hprint(v->msg_line, 46, bad);
 			hprint(v->msg_line, 56, xor);
 			dprint(v->msg_line, 66, v->ecount, 5, 0);
-			dprint(v->msg_line, 74, smp_my_cpu_num(), 2,1);
+			cpu = smp_my_cpu_num();
+			if (err_writer[cpu]) {
+				/* Written by another CPU, as writer>reader */
+				dprint(v->msg_line, 74, err_writer[cpu] - 1, 2, 0);
+				cprint(v->msg_line, 76, ">");
+				dprint(v->msg_line, 77, cpu, 2, 1);
+			} else {
+				dprint(v->msg_line, 74, cpu, 2,1);
+			}
 			v->erri.exor = xor;
 		}
 		v->erri.eadr = (ulong)adr;
@@ -432,7 +454,7 @@ char spin[4] = {'|','/','-','\\'};
 
 void do_tick(int me)
 {
-	int i, pct, cpu;
+	int i, pct, tpct, ppct, cpu;
 	ulong h, l, n, t;
 	extern int mstr_cpu;
 
@@ -464,14 +486,14 @@ void do_tick(int me)
 	nticks++;
 	v->total_ticks++;
 
-	if (test_ticks) {
-		pct = 100*nticks/test_ticks;
-		if (pct > 100) {
-			pct = 100;
-		}
-	} else {
-		pct = 0;
+	/* Use the estimate from the measured throughput if we have one,
+	 * otherwise count ticks */
+	if (!stat_eta(&tpct, &ppct)) {
+		tpct = test_ticks ? 100*nticks/test_ticks : 0;
+		ppct = v->pass_ticks ? 100*v->total_ticks/v->pass_ticks : 0;
 	}
+
+	pct = tpct > 100 ? 100 : tpct;
 	dprint(2, COL_MID+4, pct, 3, 0);
 	i = (BAR_SIZE * pct) / 100;
 	while (i > v->tptr) {
@@ -482,14 +504,7 @@ void do_tick(int me)
 		v->tptr++;
 	}
 	
-	if (v->pass_ticks) {
-		pct = 100*v->total_ticks/v->pass_ticks;
-		if (pct > 100) {
-			pct = 100;
-		}
-	} else {
-		pct = 0;
-        }
+	pct = ppct > 100 ? 100 : ppct;
 	dprint(1, COL_MID+4, pct, 3, 0);
 	i = (BAR_SIZE * pct) / 100;
 	while (i > v->pptr) {
@@ -499,6 +514,7 @@ void do_tick(int me)
 		cprint(1, COL_MID+9+v->pptr, "#");
 		v->pptr++;
 	}
+	fade_status();
 
 	if (v->ecount && v->printmode == PRINTMODE_SUMMARY) {
 		/* Compute confidence score */
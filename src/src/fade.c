@@ -0,0 +1,208 @@
+/* fade.c - MemTest-86  Version 4.1
+ *
+ * Background bit fade test.  A region of memory is held out of the other
+ * tests, filled with a pattern and checked after it has been left alone
+ * for the hold time.  The fill and check are done when the tests reach
+ * the window with the region in it, so retention is tested while the
+ * rest of memory is being tested.  After both patterns the region moves
+ * on through memory.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "smp.h"
+
+extern volatile int mstr_cpu;
+extern volatile short btflag;
+
+#define FADE_LOW	0x4000		/* Stay above 64 MB, clear of the code */
+#define FADE_MIN	0x100		/* Smallest region in pages */
+
+ulong fade_hold;		/* Hold time in seconds, 0 = no background fade */
+ulong fade_lo, fade_hi;		/* Region held for the fade, in pages */
+static ulong fade_next;		/* Where to look for the next region */
+static ulong fade_pat;
+static int fade_held;		/* The region has been filled */
+static uint64_t fade_tsc;	/* When it was filled */
+
+/* Pages of memory to test in the window starting at wstart */
+static ulong window_pages(ulong wstart)
+{
+	ulong start, end, wend, n;
+	int i;
+
+	wend = wstart + WIN_SZ;
+	if (wstart < v->plim_lower) {
+		wstart = v->plim_lower;
+	}
+	if (wend > v->plim_upper) {
+		wend = v->plim_upper;
+	}
+	for (i = 0, n = 0; i < v->msegs; i++) {
+		start = v->pmap[i].start > wstart ? v->pmap[i].start : wstart;
+		end = v->pmap[i].end < wend ? v->pmap[i].end : wend;
+		if (start < end) {
+			n += end - start;
+		}
+	}
+	return n;
+}
+
+/*
+ * Pick the next region, 1/8th of the memory being tested but no more than
+ * a quarter of a window.  It must fit in one window and leave at least as
+ * much memory in the window for the other tests.
+ */
+void fade_move(void)
+{
+	ulong size, start, end, wend;
+	int i, pass;
+
+	fade_lo = fade_hi = 0;
+	fade_held = 0;
+	fade_pat = 0;
+	if (fade_hold == 0) {
+		return;
+	}
+	size = v->selected_pages / 8;
+	if (size > WIN_SZ / 4) {
+		size = WIN_SZ / 4;
+	}
+	if (size < FADE_MIN) {
+		return;
+	}
+	for (pass = 0; pass < 2; pass++, fade_next = 0) {
+		for (i = 0; i < v->msegs; i++) {
+			start = v->pmap[i].start;
+			end = v->pmap[i].end;
+			if (start < v->plim_lower) {
+				start = v->plim_lower;
+			}
+			if (start < FADE_LOW) {
+				start = FADE_LOW;
+			}
+			if (start < fade_next) {
+				start = fade_next;
+			}
+			if (end > v->plim_upper) {
+				end = v->plim_upper;
+			}
+			for (; start + size <= end && start < MAX_MEM; start = wend) {
+				wend = (start & ~(WIN_SZ-1)) + WIN_SZ;
+				if (start + size <= wend &&
+				    window_pages(wend - WIN_SZ) >= size * 2) {
+					fade_lo = start;
+					fade_hi = start + size;
+					fade_next = fade_hi;
+					return;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Copy the memory map to pm without the region, returns the number of
+ * segments.  pm needs room for one more segment than the map.
+ */
+int fade_exclude(struct pmap *pm)
+{
+	int i, n;
+
+	for (i = 0, n = 0; i < v->msegs; i++) {
+		pm[n] = v->pmap[i];
+		if (fade_hi == 0 || pm[n].end <= fade_lo ||
+				pm[n].start >= fade_hi) {
+			n++;
+			continue;
+		}
+		/* Keep what is below and above the region */
+		if (pm[n].start < fade_lo) {
+			pm[n].end = fade_lo;
+			n++;
+			pm[n] = v->pmap[i];
+		}
+		if (pm[n].end > fade_hi) {
+			pm[n].start = fade_hi;
+			n++;
+		}
+	}
+	return n;
+}
+
+/*
+ * Fill the region, or check it once it has been held long enough and
+ * fill it with the next pattern.  The window with the region is mapped.
+ */
+static void fade_run(void)
+{
+	ulong *p, *pe, bad;
+
+	p = mapping(fade_lo);
+	pe = emapping(fade_hi);
+	if (fade_held) {
+		if (udiv64(get_tsc() - fade_tsc, v->clks_msec) <
+				fade_hold * 1000) {
+			return;
+		}
+		for (; p <= pe; p++) {
+			if ((bad = *p) != fade_pat) {
+				error(p, fade_pat, bad);
+			}
+		}
+		ACCT_RD(mstr_cpu, (fade_hi - fade_lo) << 12);
+
+		/* After both patterns move on to the next region */
+		if (fade_pat) {
+			fade_move();
+			return;
+		}
+		fade_pat = ~fade_pat;
+		p = mapping(fade_lo);
+	}
+	for (; p <= pe; p++) {
+		*p = fade_pat;
+	}
+	ACCT_WR(mstr_cpu, (fade_hi - fade_lo) << 12);
+	fade_held = 1;
+	fade_tsc = get_tsc();
+}
+
+/*
+ * Called by the CPUs that are testing a window after the test is done
+ * with it.  If the region is in this window the master does the next
+ * stage while the others wait.
+ */
+void fade_window(int me, ulong wstart, ulong wend)
+{
+	if (fade_hold == 0) {
+		return;
+	}
+	s_barrier();
+	if (me == mstr_cpu && fade_hi && fade_lo >= wstart && fade_hi <= wend) {
+		fade_run();
+	}
+	s_barrier();
+}
+
+/*
+ * Show the time left before the region is checked
+ */
+void fade_status(void)
+{
+	ulong t;
+
+	if (fade_hold == 0 || btflag) {
+		return;
+	}
+	if (!fade_held) {
+		cprint(LINE_ETA, 64, "Fade:  fill   ");
+		return;
+	}
+	t = udiv64(get_tsc() - fade_tsc, v->clks_msec * 1000);
+	t = t < fade_hold ? fade_hold - t : 0;
+	cprint(LINE_ETA, 64, "Fade:     min");
+	dprint(LINE_ETA, 69, (t + 59) / 60, 4, 0);
+}
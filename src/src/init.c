@@ -803,6 +803,84 @@ void cpu_cache_speed()
     	}
 }
 
+/*
+ * Measure the speed of a fill with cached or non-temporal stores in
+ * MB/s, the tests use the non-temporal fill when the CPU has one
+ */
+static ulong fill_speed(ulong start, ulong len, int nt)
+{
+	uint64_t t;
+	int i;
+
+	if (!cpu_id.fid.bits.rdtsc || v->clks_msec == -1 || len < 1024) {
+		return 0;
+	}
+	t = get_tsc();
+	for (i = 0; i < 10; i++) {
+		fill_words((ulong *)start, len / 4, 0, nt);
+	}
+	t = get_tsc() - t;
+	if (t == 0) {
+		return 0;
+	}
+	return udiv64((uint64_t)(len / 1024 * 10) * v->clks_msec, t);
+}
+
+/* Measure the speed of a copy engine in MB/s, half the block is copied
+ * to the other half */
+static ulong copy_speed(ulong start, ulong len, int e)
+{
+	uint64_t t;
+	int i;
+
+	if (!cpu_id.fid.bits.rdtsc || v->clks_msec == -1 || len < 2048) {
+		return 0;
+	}
+	len = (len / 2) & ~63;
+	t = get_tsc();
+	for (i = 0; i < 10; i++) {
+		copy_words((ulong *)(start + len), (ulong *)start, len / 4, e);
+	}
+	t = get_tsc() - t;
+	if (t == 0) {
+		return 0;
+	}
+	return udiv64((uint64_t)(len / 1024 * 20) * v->clks_msec, t);
+}
+
+/*
+ * Find the fastest copy engine for the block move test and display the
+ * speed of each one
+ */
+int copy_best;
+static void copy_bench(ulong start, ulong len)
+{
+	ulong s, best = 0;
+	int e, x, y, bx = 0;
+
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "Copy MB/s:");
+	}
+	for (e = 0, x = 11; e < CE_MAX; e++) {
+		if (!copy_ok(e) || (s = copy_speed(start, len, e)) == 0) {
+			continue;
+		}
+		if (s > best) {
+			best = s;
+			copy_best = e;
+			bx = x;
+		}
+		if (y >= 0) {
+			cprint(y, x, copy_name(e));
+			dprint(y, x+5, s, 7, 0);
+			x += 13;
+		}
+	}
+	if (y >= 0 && best) {
+		cprint(y, bx + 12, "*");
+	}
+}
+
 /* Measure and display memory speed, multitasked using all CPUs */
 ulong spd[MAX_CPUS];
 void get_mem_speed(int me, int ncpus)
@@ -839,6 +917,16 @@ void get_mem_speed(int me, int ncpus)
 		speed = spd[me];
 		cprint(5, 16, "       MB/s");
 		dprint(5, 16, speed, 6, 0);
+
+		/* Show what the streaming stores gain for the fills */
+		if (fill_nt_ok() && (speed = fill_speed(start, len, 0)) > 0 &&
+				(i = report_line()) >= 0) {
+			cprint(i, 0, "Memory fill:       MB/s cached,"
+				"       MB/s non-temporal");
+			dprint(i, 13, speed, 6, 0);
+			dprint(i, 32, fill_speed(start, len, 1), 6, 0);
+		}
+		copy_bench(start, len);
 	}
 }
 
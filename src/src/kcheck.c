@@ -0,0 +1,455 @@
+/* kcheck.c - MemTest-86  Version 4.1
+ *
+ * Check the test kernels in kernel.c against the assembly kernels that
+ * test.c had before them.  Each kernel and its reference run on their
+ * own copy of a buffer with a few bits flipped and the same random
+ * number seed.  They must leave the same memory, report the same errors
+ * in the same order and return the same result.  It is part of the
+ * Linux build and needs the same 32 bit C library, see linux_os.c:
+ * make kcheck && ./kcheck
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef unsigned long ulong;
+#include "kernel.h"
+
+#define MOD_SZ		20
+#define KC_WORDS	8192		/* Words in each buffer */
+#define KC_RUNS		500		/* Ranges tried for each kernel */
+#define KC_FLIPS	6		/* Bits flipped in each buffer */
+#define KC_LOG		64		/* Errors kept from each run */
+
+ulong rand(int me);
+void rand_seed(unsigned int seed1, unsigned int seed2, int me);
+void error(ulong *adr, ulong good, ulong bad);
+
+static ulong mem[2][KC_WORDS] __attribute__((aligned(64)));
+static struct {
+	ulong off, good, bad;
+} elog[2][KC_LOG];
+static int nerr[2];
+static int cur;
+
+/* Keep the errors of the current run, by offset into its buffer */
+void error(ulong *adr, ulong good, ulong bad)
+{
+	int n = nerr[cur]++;
+
+	if (n < KC_LOG) {
+		elog[cur][n].off = adr - mem[cur];
+		elog[cur][n].good = good;
+		elog[cur][n].bad = bad;
+	}
+}
+
+/*
+ * The references, as test.c had them.  Only the labels are changed
+ * so that each can be expanded more than once, and the registers they
+ * change are now outputs.
+ */
+
+/* Check for p1 and write p2 from p up to pe */
+static void ref_inv_up(ulong *p, ulong *pe, ulong p1, ulong p2)
+{
+	asm __volatile__ (
+		"jmp 2f\n\t"
+		".p2align 4,,7\n\t"
+		"1:\n\t"
+		"addl $4,%%edi\n\t"
+		"2:\n\t"
+		"movl (%%edi),%%ecx\n\t"
+		"cmpl %%eax,%%ecx\n\t"
+		"jne 3f\n\t"
+		"5:\n\t"
+		"movl %%ebx,(%%edi)\n\t"
+		"cmpl %%edx,%%edi\n\t"
+		"jb 1b\n\t"
+		"jmp 4f\n"
+
+		"3:\n\t"
+		"pushl %%edx\n\t"
+		"pushl %%ebx\n\t"
+		"pushl %%ecx\n\t"
+		"pushl %%eax\n\t"
+		"pushl %%edi\n\t"
+		"call error\n\t"
+		"popl %%edi\n\t"
+		"popl %%eax\n\t"
+		"popl %%ecx\n\t"
+		"popl %%ebx\n\t"
+		"popl %%edx\n\t"
+		"jmp 5b\n"
+
+		"4:\n\t"
+		: "+D" (p)
+		: "a" (p1), "d" (pe), "b" (p2)
+		: "ecx", "memory", "cc"
+	);
+}
+
+/* Check for p2 and write pw from p down to pe */
+static void ref_inv_down(ulong *p, ulong *pe, ulong p2, ulong pw)
+{
+	asm __volatile__ (
+		"jmp 2f\n\t"
+		".p2align 4,,7\n\t"
+		"1:\n\t"
+		"subl $4, %%edi\n\t"
+		"2:\n\t"
+		"movl (%%edi),%%ecx\n\t"
+		"cmpl %%ebx,%%ecx\n\t"
+		"jne 3f\n\t"
+		"5:\n\t"
+		"movl %%eax,(%%edi)\n\t"
+		"cmpl %%edi, %%edx\n\t"
+		"jne 1b\n\t"
+		"jmp 4f\n\t"
+
+		"3:\n\t"
+		"pushl %%edx\n\t"
+		"pushl %%eax\n\t"
+		"pushl %%ecx\n\t"
+		"pushl %%ebx\n\t"
+		"pushl %%edi\n\t"
+		"call error\n\t"
+		"popl %%edi\n\t"
+		"popl %%ebx\n\t"
+		"popl %%ecx\n\t"
+		"popl %%eax\n\t"
+		"popl %%edx\n\t"
+		"jmp 5b\n"
+
+		"4:\n\t"
+		: "+D" (p)
+		: "a" (pw), "d" (pe), "b" (p2)
+		: "ecx", "memory", "cc"
+	);
+}
+
+static ulong *ref_mod_fill(ulong *p, ulong *pe, ulong p1)
+{
+	asm __volatile__ (
+		"1:\n\t"
+		"movl %%eax,(%%edi)\n\t"
+		"addl $80,%%edi\n\t"
+		"cmpl %%edx,%%edi\n\t"
+		"jb 1b\n\t"
+		: "+D" (p)
+		: "d" (pe), "a" (p1)
+		: "memory", "cc"
+	);
+	return p;
+}
+
+static ulong *ref_mod_fill_nt(ulong *p, ulong *pe, ulong p1)
+{
+	asm __volatile__ (
+		"1:\n\t"
+		"movnti %%eax,(%%edi)\n\t"
+		"addl $80,%%edi\n\t"
+		"cmpl %%edx,%%edi\n\t"
+		"jb 1b\n\t"
+		"sfence\n\t"
+		: "+D" (p)
+		: "d" (pe), "a" (p1)
+		: "memory", "cc"
+	);
+	return p;
+}
+
+static ulong *ref_mod_chk(ulong *p, ulong *pe, ulong p1)
+{
+	asm __volatile__ (
+		"1:\n\t"
+		"movl (%%edi),%%ecx\n\t"
+		"cmpl %%eax,%%ecx\n\t"
+		"jne 3f\n\t"
+		"2:\n\t"
+		"addl $80,%%edi\n\t"
+		"cmpl %%edx,%%edi\n\t"
+		"jb 1b\n\t"
+		"jmp 4f\n\t"
+
+		"3:\n\t"
+		"pushl %%edx\n\t"
+		"pushl %%ecx\n\t"
+		"pushl %%eax\n\t"
+		"pushl %%edi\n\t"
+		"call error\n\t"
+		"popl %%edi\n\t"
+		"popl %%eax\n\t"
+		"popl %%ecx\n\t"
+		"popl %%edx\n\t"
+		"jmp 2b\n"
+
+		"4:\n\t"
+		: "+D" (p)
+		: "d" (pe), "a" (p1)
+		: "ecx", "memory", "cc"
+	);
+	return p;
+}
+
+static int ref_mod_skip(ulong *p, ulong *pe, ulong p2, int k, int offset)
+{
+	asm __volatile__ (
+		"jmp 2f\n\t"
+		".p2align 4,,7\n\t"
+		"1:\n\t"
+		"addl $4,%%edi\n\t"
+		"2:\n\t"
+		"cmpl %%ebx,%%ecx\n\t"
+		"je 3f\n\t"
+		"movl %%eax,(%%edi)\n\t"
+		"3:\n\t"
+		"incl %%ebx\n\t"
+		"cmpl $19,%%ebx\n\t"
+		"jle 4f\n\t"
+		"xorl %%ebx,%%ebx\n\t"
+		"4:\n\t"
+		"cmpl %%edx,%%edi\n\t"
+		"jb 1b\n\t"
+		: "+b" (k), "+D" (p)
+		: "d" (pe), "a" (p2), "c" (offset)
+		: "memory", "cc"
+	);
+	return k;
+}
+
+static void ref_rand_fill(ulong *p, ulong *pe, int me)
+{
+	asm __volatile__ (
+		"jmp 2f\n\t"
+		".p2align 4,,7\n\t"
+		"1:\n\t"
+		"addl $4,%%edi\n\t"
+		"2:\n\t"
+		"pushl %%ecx\n\t"
+		"call rand\n\t"
+		"popl %%ecx\n\t"
+		"movl %%eax,(%%edi)\n\t"
+		"cmpl %%ebx,%%edi\n\t"
+		"jb 1b\n\t"
+		: "+D" (p), "+c" (me)
+		: "b" (pe)
+		: "eax", "edx", "memory", "cc"
+	);
+}
+
+static void ref_rand_fill_nt(ulong *p, ulong *pe, int me)
+{
+	asm __volatile__ (
+		"jmp 2f\n\t"
+		"1:\n\t"
+		"addl $4,%%edi\n\t"
+		"2:\n\t"
+		"pushl %%ecx\n\t"
+		"call rand\n\t"
+		"popl %%ecx\n\t"
+		"movnti %%eax,(%%edi)\n\t"
+		"cmpl %%ebx,%%edi\n\t"
+		"jb 1b\n\t"
+		"sfence\n\t"
+		: "+D" (p), "+c" (me)
+		: "b" (pe)
+		: "eax", "edx", "memory", "cc"
+	);
+}
+
+/* Check for the random numbers xor xorVal and write their complement */
+static void ref_rand_inv(ulong *p, ulong *pe, ulong xorVal, int me)
+{
+	asm __volatile__ (
+		"pushl %%ebp\n\t"
+		"jmp 2f\n\t"
+		".p2align 4,,7\n\t"
+		"1:\n\t"
+		"addl $4,%%edi\n\t"
+		"2:\n\t"
+		"pushl %%edx\n\t"
+		"call rand\n\t"
+		"popl %%edx\n\t"
+		"xorl %%ebx,%%eax\n\t"
+		"movl (%%edi),%%ecx\n\t"
+		"cmpl %%eax,%%ecx\n\t"
+		"jne 3f\n\t"
+		"5:\n\t"
+		"movl $0xffffffff,%%ebp\n\t"
+		"xorl %%ebp,%%eax\n\t"
+		"movl %%eax,(%%edi)\n\t"
+		"cmpl %%esi,%%edi\n\t"
+		"jb 1b\n\t"
+		"jmp 4f\n"
+
+		"3:\n\t"
+		"pushl %%edx\n\t"
+		"pushl %%ecx\n\t"
+		"pushl %%eax\n\t"
+		"pushl %%edi\n\t"
+		"call error\n\t"
+		"popl %%edi\n\t"
+		"popl %%eax\n\t"
+		"popl %%ecx\n\t"
+		"popl %%edx\n\t"
+		"jmp 5b\n"
+
+		"4:\n\t"
+		"popl %%ebp\n\t"
+		: "+D" (p), "+d" (me)
+		: "S" (pe), "b" (xorVal)
+		: "eax", "ecx", "memory", "cc"
+	);
+}
+
+/*
+ * Run kernel k (0 is the reference) on the range from p to pe.  Returns
+ * what the kernel returns, pointers as offsets into the buffer.
+ */
+static ulong t_inv_up(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	(k ? k_inv_up : ref_inv_up)(p, pe, x, ~x);
+	return 0;
+}
+
+static ulong t_inv_down(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	(k ? k_inv_down : ref_inv_down)(pe, p, x, ~x);
+	return 0;
+}
+
+static ulong t_mod_fill(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	return (k ? k_mod_fill : ref_mod_fill)(p, pe, ~x) - mem[k];
+}
+
+static ulong t_mod_fill_nt(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	return (k ? k_mod_fill_nt : ref_mod_fill_nt)(p, pe, ~x) - mem[k];
+}
+
+static ulong t_mod_chk(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	return (k ? k_mod_chk : ref_mod_chk)(p, pe, x) - mem[k];
+}
+
+static ulong t_mod_skip(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	return (k ? k_mod_skip : ref_mod_skip)(p, pe, ~x, o / MOD_SZ,
+		o % MOD_SZ);
+}
+
+static ulong t_rand_fill(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	(k ? k_rand_fill : ref_rand_fill)(p, pe, 0);
+	return 0;
+}
+
+static ulong t_rand_fill_nt(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	(k ? k_rand_fill_nt : ref_rand_fill_nt)(p, pe, 0);
+	return 0;
+}
+
+static ulong t_rand_inv(int k, ulong *p, ulong *pe, ulong x, int o)
+{
+	(k ? k_rand_inv : ref_rand_inv)(p, pe, x, 0);
+	return 0;
+}
+
+static struct {
+	const char *name;
+	ulong (*run)(int k, ulong *p, ulong *pe, ulong x, int o);
+	int rnd;		/* The range holds the random numbers */
+} kc[] = {
+	{ "inv_up", t_inv_up, 0 },
+	{ "inv_down", t_inv_down, 0 },
+	{ "mod_fill", t_mod_fill, 0 },
+	{ "mod_fill_nt", t_mod_fill_nt, 0 },
+	{ "mod_chk", t_mod_chk, 0 },
+	{ "mod_skip", t_mod_skip, 0 },
+	{ "rand_fill", t_rand_fill, 0 },
+	{ "rand_fill_nt", t_rand_fill_nt, 0 },
+	{ "rand_inv", t_rand_inv, 1 },
+};
+
+/* Compare the two runs, returns 0 when they did the same */
+static int kc_diff(const char *name, ulong *ret)
+{
+	int i, n;
+
+	if (ret[0] != ret[1]) {
+		printf("%s: returned %lu, reference %lu\n", name,
+			ret[1], ret[0]);
+		return 1;
+	}
+	for (i = 0; i < KC_WORDS; i++) {
+		if (mem[0][i] != mem[1][i]) {
+			printf("%s: word %d is %08lx, reference %08lx\n",
+				name, i, mem[1][i], mem[0][i]);
+			return 1;
+		}
+	}
+	if (nerr[0] != nerr[1]) {
+		printf("%s: %d errors, reference %d\n", name, nerr[1],
+			nerr[0]);
+		return 1;
+	}
+	n = nerr[0] < KC_LOG ? nerr[0] : KC_LOG;
+	if (memcmp(elog[0], elog[1], n * sizeof(elog[0][0]))) {
+		printf("%s: the errors differ from the reference\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	ulong *p, x, ret[2];
+	unsigned int s1, s2;
+	int i, j, r, off, len, o, bad, fails = 0;
+
+	rand_seed(0x12345678, 0x9abcdef0, 1);
+	for (i = 0; i < sizeof(kc) / sizeof(kc[0]); i++) {
+		bad = 0;
+		for (r = 0; r < KC_RUNS && !bad; r++) {
+			/* Short ranges and any alignment at the start and end */
+			off = rand(1) % 64;
+			len = r & 1 ? rand(1) % 64 + 1 :
+				rand(1) % (KC_WORDS - 64) + 1;
+			p = mem[0] + off;
+			x = rand(1);
+			o = rand(1) % (MOD_SZ * MOD_SZ);
+			s1 = rand(1);
+			s2 = rand(1);
+
+			for (j = 0; j < KC_WORDS; j++) {
+				mem[0][j] = x;
+			}
+			if (kc[i].rnd) {
+				rand_seed(s1, s2, 0);
+				for (j = 0; j < len; j++) {
+					p[j] = rand(0) ^ x;
+				}
+			}
+			for (j = 0; j < KC_FLIPS; j++) {
+				mem[0][rand(1) % KC_WORDS] ^= 1 << rand(1) % 32;
+			}
+			memcpy(mem[1], mem[0], sizeof(mem[0]));
+
+			for (cur = 0; cur < 2; cur++) {
+				nerr[cur] = 0;
+				rand_seed(s1, s2, 0);
+				ret[cur] = kc[i].run(cur, mem[cur] + off,
+					mem[cur] + off + len - 1, x, o);
+			}
+			bad = kc_diff(kc[i].name, ret);
+		}
+		printf("%-14s%s\n", kc[i].name, bad ? "FAILED" : "ok");
+		fails += bad;
+	}
+	return fails != 0;
+}
@@ -0,0 +1,37 @@
+/* kernel.c - MemTest-86  Version 4.1
+ *
+ * The test kernels, expanded from the templates in kernel.h.  This file
+ * is built with optimization, see the Makefile.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "kernel.h"
+
+ulong rand(int me);
+
+/* Non-temporal store of a word */
+static inline void k_nt(volatile ulong *a, ulong v)
+{
+	asm __volatile__ ("movnti %1,%0" : "=m" (*a) : "r" (v));
+}
+
+/*
+ * Moving inversions, from p up to pe and from p down to pe.  Each cell
+ * is read and then written before the next one, which the march order
+ * depends on.
+ */
+K_INV(k_inv_up, 1, K_ST)
+K_INV(k_inv_down, -1, K_ST)
+
+/* Modulo 20 */
+K_SFILL(k_mod_fill, MOD_SZ, K_ST)
+K_SFILL(k_mod_fill_nt, MOD_SZ, K_NT)
+K_SCHK(k_mod_chk, MOD_SZ)
+K_SKIP(k_mod_skip, MOD_SZ, K_ST)
+
+/* Random number sequence */
+K_RFILL(k_rand_fill, K_ST)
+K_RFILL(k_rand_fill_nt, K_NT)
+K_RINV(k_rand_inv, K_ST)
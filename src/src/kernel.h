@@ -0,0 +1,155 @@
+/* kernel.h - MemTest-86  Version 4.1
+ *
+ * Templates for the test kernels.  Each access pattern is written once
+ * here and kernel.c expands it for the direction, stride and kind of
+ * store that a test uses.  They all work on 32 bit words, so each cell
+ * is read and written on its own and in the order of the march.  Memory
+ * is only accessed through volatile pointers so the compiler keeps every
+ * read and write in order, which lets kernel.c be built with
+ * optimization.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#ifndef _KERNEL_H_
+#define _KERNEL_H_
+
+/* Kinds of store and what to do after the last one */
+#define K_ST(a, v)	(*(a) = (v))
+#define K_ST_END()
+#define K_NT(a, v)	k_nt((a), (v))
+#define K_NT_END()	asm __volatile__ ("sfence" : : : "memory")
+
+/* How the kernels read memory and report a word that is wrong, the
+ * fault simulator (sim.c) reads through its fault models instead */
+#ifndef K_LD
+#define K_LD(a)		(*(a))
+#endif
+#ifndef K_ERR
+#define K_ERR(a, g, b)	error((ulong *)(a), (g), (b))
+#endif
+
+/* Check for g and write w in each word from a to b, going up (d = 1)
+ * or down (d = -1) */
+#define K_INV(name, d, st)						\
+void name(ulong *a, ulong *b, ulong g, ulong w)				\
+{									\
+	volatile ulong *q = (volatile ulong *)a, *e = (volatile ulong *)b; \
+	ulong bad;							\
+									\
+	for (;;) {							\
+		if ((bad = K_LD(q)) != g) {				\
+			K_ERR(q, g, bad);				\
+		}							\
+		st(q, w);						\
+		if (q == e) {						\
+			break;						\
+		}							\
+		q += d;							\
+	}								\
+	st##_END();							\
+}
+
+/* Write g to every s'th word from a while below b, returns where the
+ * next one would go */
+#define K_SFILL(name, s, st)						\
+ulong *name(ulong *a, ulong *b, ulong g)				\
+{									\
+	volatile ulong *q = (volatile ulong *)a;			\
+									\
+	do {								\
+		st(q, g);						\
+		q += s;							\
+	} while ((ulong *)q < b);					\
+	st##_END();							\
+	return (ulong *)q;						\
+}
+
+/* Check for g in every s'th word from a while below b */
+#define K_SCHK(name, s)							\
+ulong *name(ulong *a, ulong *b, ulong g)				\
+{									\
+	volatile ulong *q = (volatile ulong *)a;			\
+	ulong bad;							\
+									\
+	do {								\
+		if ((bad = K_LD(q)) != g) {				\
+			K_ERR(q, g, bad);				\
+		}							\
+		q += s;							\
+	} while ((ulong *)q < b);					\
+	return (ulong *)q;						\
+}
+
+/* Write g to the words from a to b except the one at position o in
+ * each period of n words, k is the position of a.  Returns the position
+ * after b. */
+#define K_SKIP(name, n, st)						\
+int name(ulong *a, ulong *b, ulong g, int k, int o)			\
+{									\
+	volatile ulong *q = (volatile ulong *)a, *e = (volatile ulong *)b; \
+									\
+	for (;;) {							\
+		if (k != o) {						\
+			st(q, g);					\
+		}							\
+		if (++k >= n) {						\
+			k = 0;						\
+		}							\
+		if (q == e) {						\
+			break;						\
+		}							\
+		q++;							\
+	}								\
+	st##_END();							\
+	return k;							\
+}
+
+/* Write the random number sequence from a to b */
+#define K_RFILL(name, st)						\
+void name(ulong *a, ulong *b, int me)					\
+{									\
+	volatile ulong *q = (volatile ulong *)a, *e = (volatile ulong *)b; \
+									\
+	for (;;) {							\
+		st(q, rand(me));					\
+		if (q == e) {						\
+			break;						\
+		}							\
+		q++;							\
+	}								\
+	st##_END();							\
+}
+
+/* Check for the random number sequence xor x and write its complement
+ * from a to b */
+#define K_RINV(name, st)						\
+void name(ulong *a, ulong *b, ulong x, int me)				\
+{									\
+	volatile ulong *q = (volatile ulong *)a, *e = (volatile ulong *)b; \
+	ulong num, bad;							\
+									\
+	for (;;) {							\
+		num = rand(me) ^ x;					\
+		if ((bad = K_LD(q)) != num) {				\
+			K_ERR(q, num, bad);				\
+		}							\
+		st(q, ~num);						\
+		if (q == e) {						\
+			break;						\
+		}							\
+		q++;							\
+	}								\
+	st##_END();							\
+}
+
+void k_inv_up(ulong *p, ulong *pe, ulong g, ulong w);
+void k_inv_down(ulong *p, ulong *pe, ulong g, ulong w);
+ulong *k_mod_fill(ulong *p, ulong *pe, ulong g);
+ulong *k_mod_fill_nt(ulong *p, ulong *pe, ulong g);
+ulong *k_mod_chk(ulong *p, ulong *pe, ulong g);
+int k_mod_skip(ulong *p, ulong *pe, ulong g, int k, int o);
+void k_rand_fill(ulong *p, ulong *pe, int me);
+void k_rand_fill_nt(ulong *p, ulong *pe, int me);
+void k_rand_inv(ulong *p, ulong *pe, ulong x, int me);
+
+#endif /* _KERNEL_H_ */
@@ -187,6 +187,23 @@ void scroll(void)
         }
 }
 
+/*
+ * Get a new line in the scroll region for a report.  Returns -1 when
+ * the region is being used for the error summary.
+ */
+int report_line(void)
+{
+	if (v->printmode == PRINTMODE_SUMMARY && v->erri.hdr_flag) {
+		return -1;
+	}
+	/* Stay below the pass complete message */
+	if (v->msg_line < LINE_MSG) {
+		v->msg_line = LINE_MSG;
+	}
+	scroll();
+	return v->msg_line;
+}
+
 /*
  * Clear scroll region
  */
@@ -271,6 +288,22 @@ void memcpy (void *dst, void *src, int len)
 	} 
 }
 
+/*
+ * Divide a 64 bit value by a 32 bit value.  We don't link with libgcc
+ * so the compiler can't do this for us.
+ */
+unsigned long long udiv64(unsigned long long n, ulong d)
+{
+	ulong hi, lo, r;
+
+	hi = n >> 32;
+	lo = n;
+	r = hi % d;
+	hi /= d;
+	asm("divl %4" : "=a" (lo), "=d" (r) : "0" (lo), "1" (r), "rm" (d));
+	return ((unsigned long long)hi << 32) | lo;
+}
+
 /*
  * Print a people friendly address
  */
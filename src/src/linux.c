@@ -0,0 +1,510 @@
+/* linux.c - MemTest-86  Version 4.1
+ *
+ * Run the tests from test.c on Linux against a locked buffer, without a
+ * reboot.  This half has the memtest side: the globals and routines the
+ * tests expect from main.c, error.c and smp.c, and the test sequence.
+ * The threads, the buffer and the output are in linux_os.c.
+ *
+ * Each thread stands in for one CPU and does what do_test() in main.c
+ * does for it.  The tests work on virtual addresses, so the address
+ * tests only check the bits inside a page unless huge pages are used.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "smp.h"
+#include "linux.h"
+
+extern struct tseq tseq[];
+void get_cpuid(void);
+void rand_seed(unsigned int seed1, unsigned int seed2, int me);
+ulong rand(int me);
+
+/* What the tests use from main.c */
+struct vars variables = {};
+struct vars * const v = &variables;
+volatile int mstr_cpu;
+volatile int run_cpus;
+volatile int test;
+volatile short cpu_mode = CPM_ALL;
+volatile short cpu_sel;
+volatile int segs, bail;
+short pipeline;
+short copy_sel;
+short simd_max;
+int copy_best;
+ulong ham_dist;
+int stress_min;
+short err_writer[MAX_CPUS];
+struct cpu_acct cpu_acct[MAX_CPUS] __attribute__((aligned(64)));
+
+static int ncpus;		/* Threads */
+static int passes;		/* Passes to run, 0 = until stopped */
+static int maxcpus = MAX_CPUS;
+static int c_iter;
+static short bench;		/* Run bench.c instead of the tests */
+static ulong sp1;		/* Random pattern for all threads */
+
+static ulong number(char *cp)
+{
+	ulong n = 0;
+
+	while (isdigit(*cp)) {
+		n = n * 10 + *cp++ - '0';
+	}
+	return n;
+}
+
+/* Parse one of the boot options that make sense here or one for the
+ * fault simulator, returns 0 if it is neither */
+int host_option(char *cp)
+{
+	int i, k;
+
+	if (!strncmp(cp, "maxcpus=", 8)) {
+		maxcpus = number(cp + 8);
+		if (maxcpus < 1 || maxcpus > MAX_CPUS) {
+			maxcpus = MAX_CPUS;
+		}
+	} else if (!strncmp(cp, "passes=", 7)) {
+		passes = number(cp + 7);
+	} else if (!strncmp(cp, "onepass", 7)) {
+		passes = 1;
+	} else if (!strncmp(cp, "tstlist=", 8)) {
+		for (k = 0; tseq[k].cpu_sel; k++) {
+			tseq[k].sel = 0;
+		}
+		for (cp += 8; isdigit(*cp); cp++) {
+			i = number(cp);
+			if (i < k) {
+				tseq[i].sel = 1;
+			}
+			while (isdigit(cp[1])) {
+				cp++;
+			}
+			if (cp[1] != ',') {
+				break;
+			}
+			cp++;
+		}
+	} else if (!strncmp(cp, "copy=", 5)) {
+		for (i = 0; i < CE_MAX; i++) {
+			if (!strncmp(cp + 5, copy_name(i),
+					strlen(copy_name(i)))) {
+				copy_sel = i + 1;
+			}
+		}
+	} else if (!strncmp(cp, "simd=", 5)) {
+		for (i = 0; i < SL_MAX; i++) {
+			if (!strncmp(cp + 5, simd_name(i),
+					strlen(simd_name(i)))) {
+				simd_max = i + 1;
+			}
+		}
+	} else if (!strncmp(cp, "hammer=", 7)) {
+		/* The distance is in hex bytes */
+		for (cp += 7; isdigit(*cp) || (*cp >= 'a' && *cp <= 'f'); cp++) {
+			ham_dist = ham_dist * 16 +
+				(isdigit(*cp) ? *cp - '0' : *cp - 'a' + 10);
+		}
+		ham_dist &= ~63;
+	} else if (!strncmp(cp, "stress=", 7)) {
+		stress_min = number(cp + 7);
+		for (i = 0; tseq[i].cpu_sel; i++) {
+			if (tseq[i].pat == 13) {
+				tseq[i].sel = 1;
+			}
+		}
+	} else if (!strncmp(cp, "bench", 5)) {
+		bench++;
+	} else if (!strncmp(cp, "pipeline", 8)) {
+		pipeline++;
+	} else {
+		return sim_option(cp);
+	}
+	return 1;
+}
+
+int host_max_cpus(void)
+{
+	return maxcpus;
+}
+
+/*
+ * The buffer is tested as one segment.  Linux has already turned on the
+ * SIMD state, so only the XCR0 bits that are on can be used.
+ */
+void host_setup(ulong *buf, ulong len, int n, ulong clks_msec)
+{
+	ulong lo, hi;
+	int y;
+
+	ncpus = n;
+	run_cpus = n;
+	v->clks_msec = clks_msec;
+	v->msegs = 1;
+	v->pmap[0].start = (ulong)buf >> 12;
+	v->pmap[0].end = ((ulong)buf + len) >> 12;
+	v->selected_pages = len >> 12;
+	v->map[0].start = buf;
+	v->map[0].end = buf + len / 4 - 1;
+	segs = 1;
+
+	get_cpuid();
+	if (cpu_id.fid.uint32_array[1] & CPUID1_OSXSAVE) {
+		asm __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+		cpu_id.xcr0_ok &= lo;
+	} else {
+		cpu_id.xcr0_ok = 0;
+	}
+	simd_select();
+	dram_find((ulong)buf, len);
+
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "Testing:       with    threads");
+		aprint(y, 9, len >> 12);
+		dprint(y, 20, n, 3, 0);
+	}
+	os_flush();
+}
+
+/*
+ * Display an error in the same form as error.c does.  Duplicate errors
+ * are not shown and only data errors (type 0) go in the BadRAM patterns.
+ */
+static void host_err(ulong *adr, ulong good, ulong bad, ulong xor, int type)
+{
+	unsigned long long pa;
+	ulong page, offset;
+	int y;
+
+	os_lock();
+	v->ecount++;
+	if (tseq[test].errors < 0xffff) {
+		tseq[test].errors++;
+	}
+	if (test != 0 && test != 5 && type == 0) {
+		insertaddress((ulong)adr);
+	}
+	if ((ulong)adr == v->erri.eadr && xor == v->erri.exor) {
+		os_unlock();
+		return;
+	}
+	v->erri.eadr = (ulong)adr;
+	v->erri.exor = xor;
+	if (v->erri.hdr_flag == 0) {
+		y = report_line();
+		cprint(y, 0,
+"Tst  Pass   Failing Address          Good       Bad     Err-Bits  Count CPU");
+		y = report_line();
+		cprint(y, 0,
+"---  ----  -----------------------  --------  --------  --------  ----- ----");
+		v->erri.hdr_flag++;
+	}
+
+	/* Show the physical address when Linux gives it to us */
+	if ((pa = os_phys(adr)) == 0) {
+		pa = (ulong)adr;
+	}
+	page = pa >> 12;
+	offset = pa & 0xfff;
+	y = report_line();
+	dprint(y, 0, test, 3, 0);
+	dprint(y, 4, v->pass, 5, 0);
+	hprint(y, 11, page);
+	hprint2(y, 19, offset, 3);
+	cprint(y, 22, " -      . MB");
+	dprint(y, 25, page >> 8, 5, 0);
+	dprint(y, 31, ((page & 0xff) * 10) / 0x100, 1, 0);
+	hprint(y, 36, good);
+	hprint(y, 46, bad);
+	hprint(y, 56, xor);
+	dprint(y, 66, v->ecount, 5, 0);
+	if (err_writer[os_cpu()]) {
+		/* Written by another CPU, as writer>reader */
+		dprint(y, 74, err_writer[os_cpu()] - 1, 2, 0);
+		cprint(y, 76, ">");
+		dprint(y, 77, os_cpu(), 2, 1);
+	} else {
+		dprint(y, 74, os_cpu(), 2, 1);
+	}
+	os_flush();
+	os_unlock();
+}
+
+void error(ulong *adr, ulong good, ulong bad)
+{
+	host_err(adr, good, bad, good ^ bad, 0);
+}
+
+/* Virtual addresses are used when Linux won't give the physical ones,
+ * the bits inside a huge page are still right */
+unsigned long long dram_phys(void *p)
+{
+	unsigned long long pa = os_phys(p);
+
+	return pa ? pa : (ulong)p;
+}
+
+void ad_err1(ulong *adr1, ulong *mask, ulong bad, ulong good)
+{
+	host_err(adr1, good, bad, (ulong)mask, 1);
+}
+
+void ad_err2(ulong *adr, ulong bad)
+{
+	host_err(adr, (ulong)adr, bad, (ulong)adr ^ bad, 0);
+}
+
+void do_tick(int me)
+{
+	if (os_stopped()) {
+		bail = 1;
+	}
+}
+
+void barrier(void)
+{
+	os_barrier(ncpus);
+}
+
+void s_barrier_init(int max)
+{
+}
+
+int smp_ord_to_cpu(int me)
+{
+	return os_ord_to_cpu(me);
+}
+
+void s_barrier(void)
+{
+	if (run_cpus > 1) {
+		os_barrier(run_cpus);
+	}
+}
+
+void stat_idle(int flag)
+{
+}
+
+void btrace(int me, int line, char *msg, int delay, long v1, long v2)
+{
+}
+
+unsigned long long udiv64(unsigned long long n, ulong d)
+{
+	return n / d;
+}
+
+unsigned long long get_tsc(void)
+{
+	ulong lo, hi;
+
+	asm __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long)hi << 32) | lo;
+}
+
+/* One test for one thread, see do_test() in main.c */
+static void host_test(int me)
+{
+	ulong i, j, p0, p1, p2;
+
+	switch(tseq[test].pat) {
+	case 0:
+		addr_tst1(me);
+		break;
+	case 1:
+		addr_tst2(me, 1);
+		break;
+	case 2:
+		addr_tst2(me, 0);
+		break;
+	case 3:
+	case 4:
+		p1 = 0;
+		p2 = ~p1;
+		s_barrier();
+		movinv1(c_iter, p1, p2, 0, 0, me);
+		BAILR
+		s_barrier();
+		movinv1(c_iter, p2, p1, 0, 0, me);
+		break;
+	case 5:
+		for (i = 0, p0 = 0x80; i < 8; i++, p0 >>= 1) {
+			p1 = p0 | (p0 << 8) | (p0 << 16) | (p0 << 24);
+			p2 = ~p1;
+			s_barrier();
+			movinv1(c_iter, p1, p2, 0, 0, me);
+			BAILR
+			s_barrier();
+			movinv1(c_iter, p2, p1, 0, 0, me);
+			BAILR
+		}
+		break;
+	case 6:
+		if (me == mstr_cpu) {
+			rand_seed(get_tsc(), get_tsc() >> 32, 0);
+		}
+		for (i = 0; i < c_iter; i++) {
+			s_barrier();
+			if (me == mstr_cpu) {
+				sp1 = rand(0);
+			}
+			s_barrier();
+			movinv1(2, sp1, ~sp1, 0, 0, me);
+			BAILR
+		}
+		break;
+	case 7:
+		block_move(c_iter, me);
+		break;
+	case 8:
+		for (i = 0, p1 = 1; p1; p1 <<= 1, i++) {
+			s_barrier();
+			movinv32(c_iter, p1, 1, 0x80000000, 0, i, me);
+			BAILR
+			s_barrier();
+			movinv32(c_iter, ~p1, 0xfffffffe, 0x7fffffff, 1, i, me);
+			BAILR
+		}
+		break;
+	case 9:
+		for (i = 0; i < c_iter; i++) {
+			s_barrier();
+			movinvr(me);
+			BAILR
+		}
+		break;
+	case 10:
+		for (j = 0; j < c_iter; j++) {
+			p1 = rand(0);
+			for (i = 0; i < MOD_SZ; i++) {
+				p2 = ~p1;
+				s_barrier();
+				modtst(i, 2, p1, p2, me);
+				BAILR
+				s_barrier();
+				modtst(i, 2, p2, p1, me);
+				BAILR
+			}
+		}
+		break;
+	case 11:
+		for (p1 = 0, i = 0; i < 2; i++, p1 = ~p1) {
+			bit_fade_fill(p1, me);
+			s_barrier();
+			sleep(c_iter, 0, me);
+			bit_fade_chk(p1, me);
+			BAILR
+			s_barrier();
+		}
+		break;
+	case 12:
+		hammer(c_iter, me);
+		break;
+	case 13:
+		stress(me);
+		break;
+	case 14:
+		cross_cpu(c_iter, me);
+		break;
+	}
+}
+
+/*
+ * Run the tests in the order of tseq[], called by every thread.  A test
+ * that memtest runs on one CPU at a time is run by the first thread.
+ */
+void host_run(int me)
+{
+	int y;
+
+	if (bench) {
+		bench_run(me, ncpus, (ulong)v->map[0].start,
+			v->selected_pages << 12);
+		return;
+	}
+	for (;;) {
+		for (test = 0; tseq[test].cpu_sel; test++) {
+			if (!tseq[test].sel) {
+				continue;
+			}
+			os_barrier(ncpus);
+			if (me == mstr_cpu) {
+				run_cpus = tseq[test].cpu_sel == -1 ? 1 : ncpus;
+				c_iter = v->pass ? tseq[test].iter :
+					tseq[test].iter / 3;
+				os_lock();
+				if ((y = report_line()) >= 0) {
+					cprint(y, 0, "Pass      Test   ");
+					dprint(y, 5, v->pass, 4, 0);
+					dprint(y, 15, test, 2, 0);
+					cprint(y, 18, tseq[test].msg);
+				}
+				os_flush();
+				os_unlock();
+			}
+			os_barrier(ncpus);
+			if (me < run_cpus) {
+				host_test(me);
+			}
+			if (bail) {
+				return;
+			}
+			if (tseq[test].pat == 12 || tseq[test].pat == 13) {
+				os_barrier(ncpus);
+				if (me == mstr_cpu) {
+					os_lock();
+					if (tseq[test].pat == 12) {
+						hammer_report();
+					} else {
+						stress_report();
+					}
+					os_flush();
+					os_unlock();
+				}
+			}
+		}
+		os_barrier(ncpus);
+		if (me == mstr_cpu) {
+			v->pass++;
+		}
+		os_barrier(ncpus);
+		if (passes && v->pass >= passes) {
+			return;
+		}
+	}
+}
+
+/* Show the totals and the BadRAM patterns, returns the errors found */
+int host_done(void)
+{
+	int i, x, y = 0;
+
+	os_lock();
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "Passes:       Errors:");
+		dprint(y, 8, v->pass, 5, 0);
+		dprint(y, 22, v->ecount, 8, 1);
+	}
+	for (i = 0, x = 80; i < v->numpatn; i++, x += 22) {
+		if (x > 80 - 22) {
+			y = report_line();
+			cprint(y, 0, "badram=");
+			x = 7;
+		}
+		cprint(y, x, "0x");
+		hprint(y, x + 2, v->patn[i].adr);
+		cprint(y, x + 10, ",0x");
+		hprint(y, x + 13, v->patn[i].mask);
+		if (i + 1 < v->numpatn) {
+			cprint(y, x + 21, ",");
+		}
+	}
+	os_flush();
+	os_unlock();
+	return v->ecount;
+}
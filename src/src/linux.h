@@ -0,0 +1,34 @@
+/* linux.h - MemTest-86  Version 4.1
+ *
+ * Interface between the two halves of the Linux build.  linux.c is built
+ * with the memtest headers and linux_os.c with the C library, since the
+ * two can't be included together.  Only plain C types are used here.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#ifndef _LINUX_H_
+#define _LINUX_H_
+
+/* linux.c */
+int host_option(char *cp);
+int host_max_cpus(void);
+void host_setup(unsigned long *buf, unsigned long len, int ncpus,
+	unsigned long clks_msec);
+void host_run(int me);
+int host_done(void);
+
+/* sim.c */
+int sim_option(char *cp);
+int sim_run(void);
+
+/* linux_os.c */
+void os_lock(void);
+void os_unlock(void);
+void os_barrier(int n);
+int os_cpu(void);
+int os_ord_to_cpu(int me);
+int os_stopped(void);
+unsigned long long os_phys(void *p);
+void os_flush(void);
+
+#endif /* _LINUX_H_ */
@@ -0,0 +1,306 @@
+/* linux_os.c - MemTest-86  Version 4.1
+ *
+ * The C library half of the Linux build: the locked buffer, one thread
+ * pinned to each CPU, the barriers and the output.  The routines the
+ * tests use to print are done here with one line of "screen" for the
+ * report lines, the other lines of the memtest screen are dropped.
+ *
+ *   memtest-linux <MB> [maxcpus=N] [tstlist=a,b,..] [passes=N]
+ *		[onepass] [simd=level] [copy=engine] [pipeline] [bench]
+ *		[hammer=hex] [stress=min]
+ *   memtest-linux sim=<trials> [simbw=<MB/s>] [tstlist=a,b,..]
+ *
+ * The second form runs the fault simulator in sim.c instead.  It is
+ * built with "make memtest-linux", which needs gcc with 32 bit support
+ * and the 32 bit C library (gcc-multilib or glibc-devel.i686).
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "linux.h"
+
+#define HUGE_SZ		(2UL << 20)
+#define MAX_THREADS	32		/* MAX_CPUS in smp.h */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int stop;
+static volatile int bar_count, bar_sense, running;
+static __thread int my_sense, my_cpu;
+static int pagemap = -1;
+
+static char line[81];
+static int line_y = -1, next_y = 1000;
+
+void os_lock(void)
+{
+	pthread_mutex_lock(&lock);
+}
+
+void os_unlock(void)
+{
+	pthread_mutex_unlock(&lock);
+}
+
+/* Wait for n threads, gives up once we are told to stop */
+void os_barrier(int n)
+{
+	my_sense = !my_sense;
+	if (__sync_add_and_fetch(&bar_count, 1) == n) {
+		bar_count = 0;
+		__sync_synchronize();
+		bar_sense = my_sense;
+		return;
+	}
+	while (bar_sense != my_sense && !stop) {
+		asm __volatile__ ("pause");
+	}
+}
+
+int os_cpu(void)
+{
+	return my_cpu;
+}
+
+int os_stopped(void)
+{
+	return stop;
+}
+
+/* The physical address of p, 0 if Linux does not tell us */
+unsigned long long os_phys(void *p)
+{
+	uint64_t e;
+	unsigned long pg = (unsigned long)p >> 12;
+
+	if (pagemap < 0 ||
+			pread(pagemap, &e, 8, (off_t)pg * 8) != 8 ||
+			!(e & (1ULL << 63)) || (e & ((1ULL << 55) - 1)) == 0) {
+		return 0;
+	}
+	return ((e & ((1ULL << 55) - 1)) << 12) | ((unsigned long)p & 0xfff);
+}
+
+/* Report lines, each one is printed when the next one is started */
+void os_flush(void)
+{
+	int i;
+
+	if (line_y < 0) {
+		return;
+	}
+	for (i = 79; i >= 0 && line[i] == ' '; i--)
+		;
+	line[i + 1] = 0;
+	puts(line);
+	fflush(stdout);
+	line_y = -1;
+}
+
+int report_line(void)
+{
+	os_flush();
+	memset(line, ' ', 80);
+	line[80] = 0;
+	line_y = next_y++;
+	return line_y;
+}
+
+void cprint(int y, int x, const char *s)
+{
+	if (y != line_y || x < 0) {
+		return;
+	}
+	for (; *s && x < 80; x++) {
+		line[x] = *s++;
+	}
+}
+
+void dprint(int y, int x, unsigned long val, int len, int right)
+{
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), right ? "%-*lu" : "%*lu", len, val);
+	cprint(y, x, buf);
+}
+
+void hprint2(int y, int x, unsigned long val, int digits)
+{
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), "%0*lx", digits > 8 ? 8 : digits, val);
+	cprint(y, x, buf);
+}
+
+void hprint(int y, int x, unsigned long val)
+{
+	hprint2(y, x, val, 8);
+}
+
+void aprint(int y, int x, unsigned long page)
+{
+	char buf[24];
+
+	if ((page << 2) < 9999) {
+		snprintf(buf, sizeof(buf), "%4luK", page << 2);
+	} else if ((page >> 8) < 9999) {
+		snprintf(buf, sizeof(buf), "%4luM", (page + (1 << 7)) >> 8);
+	} else {
+		snprintf(buf, sizeof(buf), "%4luG", (page + (1 << 17)) >> 18);
+	}
+	cprint(y, x, buf);
+}
+
+/*
+ * Get the buffer, from huge pages if there are any so that the address
+ * bits inside 2 MB are physical ones.  It is locked so it stays put.
+ */
+static unsigned long *get_buf(unsigned long len)
+{
+	void *p;
+
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+		/* Ask for transparent huge pages instead */
+		p = mmap(NULL, len + HUGE_SZ, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			return NULL;
+		}
+		p = (void *)(((unsigned long)p + HUGE_SZ - 1) &
+			~(HUGE_SZ - 1));
+		madvise(p, len, MADV_HUGEPAGE);
+	}
+	if (mlock(p, len)) {
+		fprintf(stderr, "mlock: %s\n", strerror(errno));
+		return NULL;
+	}
+	return p;
+}
+
+/* TSC clocks per millisecond, timed against the monotonic clock */
+static unsigned long tsc_khz(void)
+{
+	struct timespec t0, t1;
+	uint32_t lo, hi;
+	uint64_t c0, c1;
+	long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	asm __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	c0 = ((uint64_t)hi << 32) | lo;
+	usleep(100000);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	asm __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	c1 = ((uint64_t)hi << 32) | lo;
+	ns = (t1.tv_sec - t0.tv_sec) * 1000000000L + t1.tv_nsec - t0.tv_nsec;
+	return (c1 - c0) * 1000000 / ns;
+}
+
+static struct thr {
+	pthread_t t;
+	int me;
+	int cpu;
+} thr[MAX_THREADS];
+
+/* The CPU that thread me runs on */
+int os_ord_to_cpu(int me)
+{
+	return thr[me].cpu;
+}
+
+static void *thread(void *arg)
+{
+	struct thr *t = arg;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(t->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	my_cpu = t->cpu;
+	host_run(t->me);
+	__sync_sub_and_fetch(&running, 1);
+	return NULL;
+}
+
+static void on_signal(int sig)
+{
+	stop = 1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: memtest-linux <MB> [maxcpus=N] "
+		"[tstlist=a,b,..] [passes=N] [onepass]\n"
+		"\t[simd=level] [copy=engine] [pipeline] [bench] [hammer=hex]\n"
+		"\t[stress=min]\n"
+		"       memtest-linux sim=<trials> [simbw=<MB/s>] "
+		"[tstlist=a,b,..]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	cpu_set_t set;
+	unsigned long mb = 0, len, *buf;
+	int i, n, c, wait;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+			mb = strtoul(argv[i], NULL, 10);
+		} else if (!host_option(argv[i])) {
+			usage();
+		}
+	}
+	if ((i = sim_run()) >= 0) {
+		return i;
+	}
+	if (mb == 0 || mb >= 4096) {
+		usage();
+	}
+	len = mb << 20;
+	if ((buf = get_buf(len)) == NULL) {
+		fprintf(stderr, "Can't get %lu MB of locked memory\n", mb);
+		return 2;
+	}
+	pagemap = open("/proc/self/pagemap", O_RDONLY);
+
+	/* One thread for each CPU we may run on */
+	sched_getaffinity(0, sizeof(set), &set);
+	n = CPU_COUNT(&set);
+	if (n > host_max_cpus()) {
+		n = host_max_cpus();
+	}
+	host_setup(buf, len, n, tsc_khz());
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	running = n;
+	for (i = 0, c = 0; i < n; i++, c++) {
+		while (!CPU_ISSET(c, &set)) {
+			c++;
+		}
+		thr[i].me = i;
+		thr[i].cpu = c;
+		pthread_create(&thr[i].t, NULL, thread, &thr[i]);
+	}
+
+	/* A thread can be in a bit fade wait, so don't wait long once we
+	 * are told to stop */
+	for (wait = 0; running && wait < 20; wait += stop) {
+		usleep(100000);
+	}
+	return host_done() ? 1 : 0;
+}
@@ -33,39 +33,22 @@ extern void	rand_seed(unsigned int seed1, unsigned int seed2, int cpu);
 extern struct	barrier_s *barr;
 extern int 	num_cpus;
 extern int 	act_cpus;
+extern ulong	fade_hold, fade_lo;
 
 static int	find_ticks_for_test(int test);
 void		find_ticks_for_pass(void);
 int		find_chunks(int test);
+int		find_iter(int tst, int pass);
+int		find_next_test(int tst);
+static int	find_cpus(int tst);
+static int	find_turns(int tst);
 static void	test_setup(void);
 static int	compute_segments(struct pmap map, int cpu);
+static void	plan_window(struct pmap *win, int *w, ulong *next);
 int		do_test(int ord);
 
-/*
-from test.h (for reference)
-struct tseq {
-	short sel;				// Boolean toggle stating wether to run the test, on by default
-	short cpu_sel;			// Number of CPUs to run this test on, -1 means every CPU seperately in order
-	short pat;				// Which test pattern to use for this test, see do_test() in main.c
-	short iter;				// Number of times (iterations) to repeat the test, this value is divided by 3 on first pass
-	unsigned short errors;	// Count of errors encountered in this test, initialized to 0
-	char *msg;				// Test description for display
-};
-*/
-struct tseq tseq[] = {
-	{1, -1,  0,   6, 0, "[Address test, walking ones, no cache] "}, // 0
-	{1, -1,  1,   6, 0, "[Address test, own address Sequential] "}, // 1
-	{1, 32,  2,   6, 0, "[Address test, own address Parallel]   "}, // 2
-	{1, 32,  3,   6, 0, "[Moving inversions, 1s & 0s Parallel]  "}, // 3
-	{1, 32,  5,   3, 0, "[Moving inversions, 8 bit pattern]     "}, // 4
-	{1, 32,  6,  30, 0, "[Moving inversions, random pattern]    "}, // 5
-	{1, 32,  7,  81, 0, "[Block move]                           "}, // 6
-	{1, 32,  8,   3, 0, "[Moving inversions, 32 bit pattern]    "}, // 7
-	{1, 32,  9,  24, 0, "[Random number sequence]               "}, // 8
-    {1, 32, 10,   6, 0, "[Modulo 20, Random pattern]            "}, // 9
-	{1, 1,  11, 240, 0, "[Bit fade test, 2 patterns]            "}, // 10
-	{1, 0,   0,   0, 0, NULL}
-};
+/* The test sequence is in tseq.c, it is shared with the Linux build */
+extern struct tseq tseq[];
 
 volatile int    mstr_cpu;
 volatile int	run_cpus;
@@ -76,6 +59,18 @@ volatile short	cpu_mode;
 char		cpu_mask[MAX_CPUS];
 long 		bin_mask=0xffffffff;
 short		onepass;
+short		nopmu;
+short		pmu_guest;	/* Use the PMU under a hypervisor too */
+short		addr_par;	/* Run the address test on all CPUs at once */
+short		pipeline;	/* Pipelined moving inversions */
+short		memtype;	/* Memory type for the memory under test */
+short		mtrrfix;	/* Make the RAM write back in the MTRRs */
+short		copy_sel;	/* Block move copy engine + 1, 0 = rotate */
+short		simd_max;	/* Highest kernel level + 1, 0 = any */
+short		bench;		/* Time the test kernels at startup */
+ulong		ham_dist;	/* Row hammer pair distance, 0 = by timing */
+int		budget_min;	/* Time budget in minutes, 0 = none */
+int		stress_min;	/* Stress test minutes, 0 = STRESS_SEC */
 volatile short	btflag = 0;
 volatile int	test;
 short	        restart_flag;				 // Restart from first test
@@ -99,11 +94,28 @@ volatile static int window;
 volatile static unsigned long win_next;
 volatile static ulong win0_start;	/* Start test address for window 0 */
 volatile static ulong win1_end;		/* End address for relocation */
+
+/* Windows with memory to test, see compute_windows() */
+static struct pmap win_plan[MAX_MEM_SEGMENTS+1];
+static int win_cnt;
 volatile static struct pmap winx;  	/* Window struct for mapping windows */
 
 /* Find the next selected test to run */
 void next_test()
 {
+	int i;
+
+	/* With a time budget the plan picks the tests */
+	if (budget_min) {
+		if ((i = budget_next()) < 0) {
+			pass_flag++;
+			i = budget_pass();
+		}
+		if (i >= 0) {
+			test = i;
+		}
+		return;
+	}
 	test++;
 	while (tseq[test].sel == 0 && tseq[test].cpu_sel != 0) {
 	    test++;
@@ -148,6 +160,15 @@ void set_defaults()
 	v->numpatn=0;
 	v->plim_lower = 0;
 	v->plim_upper = v->pmap[v->msegs-1].end;
+	compute_windows();
+
+	/* With the caches left on the address test can run on all of the
+	 * CPUs at once instead of on each one in turn.  Only when asked
+	 * for, as each CPU then walks the address bits inside its banks and
+	 * the high bits are only walked from the one base address. */
+	if (addr_par && addr_flush_ok()) {
+		tseq[0].cpu_sel = 32;
+	}
 	v->pass = 0;
 	v->msg_line = 0;
 	v->ecount = 0;
@@ -320,6 +341,107 @@ static void parse_command_line(void)
 			cp += 8;
 			maxcpus=(int)simple_strtoul(cp, &dummy, 10);
 		}
+		/* Run the bit fade in the background, hold for N minutes */
+		if (!strncmp(cp, "bgfade", 6)) {
+			cp += 6;
+			fade_hold = 240;
+			if (*cp == '=') {
+				cp++;
+				fade_hold = simple_strtoul(cp, &dummy, 10) * 60;
+			}
+			/* It replaces the bit fade test */
+			for (i = 0; tseq[i].cpu_sel; i++) {
+				if (tseq[i].pat == 11) {
+					tseq[i].sel = 0;
+				}
+			}
+		}
+		/* Don't use the performance counters */
+		if (!strncmp(cp, "nopmu", 5)) {
+			cp += 5;
+			nopmu++;
+		}
+		/* Run the walking ones address test on all CPUs at once */
+		if (!strncmp(cp, "addrpar", 7)) {
+			cp += 7;
+			addr_par++;
+		}
+		/* Use the performance counters under a hypervisor too */
+		if (!strncmp(cp, "pmu", 3)) {
+			cp += 3;
+			pmu_guest++;
+		}
+		/* Change the MTRRs so that all of RAM is write back */
+		if (!strncmp(cp, "mtrrfix", 7)) {
+			cp += 7;
+			mtrrfix++;
+		}
+		/* Memory type for the memory under test */
+		if (!strncmp(cp, "memtype=", 8)) {
+			cp += 8;
+			if (!strncmp(cp, "wt", 2)) {
+				memtype = MT_WT;
+			} else if (!strncmp(cp, "uc", 2)) {
+				memtype = MT_UC;
+			} else if (!strncmp(cp, "wc", 2)) {
+				memtype = MT_WC;
+			} else {
+				memtype = MT_WB;
+			}
+		}
+		/* Copy engine for the block move test */
+		if (!strncmp(cp, "copy=", 5)) {
+			cp += 5;
+			for (i = 0; i < CE_MAX; i++) {
+				if (!strncmp(cp, copy_name(i),
+						strlen(copy_name(i)))) {
+					copy_sel = i + 1;
+				}
+			}
+		}
+		/* Limit the test kernels to a level of CPU features */
+		if (!strncmp(cp, "simd=", 5)) {
+			cp += 5;
+			for (i = 0; i < SL_MAX; i++) {
+				if (!strncmp(cp, simd_name(i),
+						strlen(simd_name(i)))) {
+					simd_max = i + 1;
+				}
+			}
+		}
+		/* Distance in bytes (hex) between the row hammer pairs */
+		if (!strncmp(cp, "hammer=", 7)) {
+			cp += 7;
+			ham_dist = simple_strtoul(cp, &dummy, 16) & ~63;
+		}
+		/* Time the test kernels at startup */
+		if (!strncmp(cp, "bench", 5)) {
+			cp += 5;
+			bench++;
+		}
+		/* Overlap the phases of the moving inversions tests */
+		if (!strncmp(cp, "pipeline", 8)) {
+			cp += 8;
+			pipeline++;
+		}
+		/* Run the stress test for N minutes in each pass */
+		if (!strncmp(cp, "stress=", 7)) {
+			cp += 7;
+			stress_min = simple_strtoul(cp, &dummy, 10);
+			for (i = 0; tseq[i].cpu_sel; i++) {
+				if (tseq[i].pat == 13) {
+					tseq[i].sel = 1;
+				}
+			}
+		}
+		/* Fit the tests into a time budget in minutes */
+		if (!strncmp(cp, "budget=", 7)) {
+			cp += 7;
+			budget_min = simple_strtoul(cp, &dummy, 10);
+			if (budget_min < 0 || budget_min > BUDGET_MAX) {
+				budget_min = BUDGET_MAX;
+			}
+		}
 		/* Run one pass and exit if there are no errors */
 		if (!strncmp(cp, "onepass", 7)) {
 			cp += 7;
@@ -376,6 +498,12 @@ static void parse_command_line(void)
 	cmdline_parsed = 1;
 }
 
+/* The test window below 4 GB is mapped one to one */
+unsigned long long dram_phys(void *p)
+{
+	return (ulong)p;
+}
+
 void clear_screen()
 {
 	int i;
@@ -399,7 +527,9 @@ void clear_screen()
  * we relocate. */
 void test_start(void)
 {
-	int my_cpu_num, my_cpu_ord, run;
+	int my_cpu_num, my_cpu_ord, run, w;
+	ulong wn;
+	struct pmap wp;
 
 	/* If this is the first time here we are CPU 0 */
 	if (start_seq == 0) {
@@ -433,6 +563,9 @@ void test_start(void)
 		barrier_init(1);
 		/* Fill in the CPUID table */
 		get_cpuid();
+		if (!nopmu) {
+			pmu_setup();
+		}
 		/* Startup the other CPUs */
 		start_seq = 1;
 		initialise_cpus();
@@ -440,8 +573,14 @@ void test_start(void)
 		/* Draw the screen and get system information */
 	   	init();
 
+		/* Pick the test kernels for this CPU */
+		simd_select();
+
 		/* Set defaults and initialize variables */
 		set_defaults();
+
+		/* Check for RAM that the MTRRs don't make write back */
+		mtrr_audit();
 	
 		/* Setup base address for testing, 1 MB */
 		win0_start = 0x100;
@@ -477,6 +616,7 @@ void test_start(void)
 		}
 #endif
 		win1_end = (high_test_adr >> 12);
+		compute_windows();
 
 		find_ticks_for_pass();
        	    } else {
@@ -521,6 +661,10 @@ void test_start(void)
                     : "ax"
                 );
 
+	   /* Set up the memory types we use in the page tables */
+	   mtrr_apply();
+	   pat_setup();
+
 	   if (cpu_id.fid.bits.sse)
         	__asm__ __volatile__ (
                     "movl %%cr4, %%eax\n\t"
@@ -530,6 +674,9 @@ void test_start(void)
                     : "ax"
                 );
 
+	   /* Enable the AVX and AVX-512 registers for the test kernels */
+	   simd_setup();
+
 	    btrace(my_cpu_num, __LINE__, "Mem Mgmnt ", 1, cpu_id.fid.bits.pae,
 		cpu_id.fid.bits.lm);
 	    /* Setup memory management modes */
@@ -558,6 +705,25 @@ void test_start(void)
             }
 	    /* Get the memory Speed with all CPUs */
 		get_mem_speed(my_cpu_num, num_cpus);
+
+		/* Plan the tests for a time budget, this uses the memory speed */
+		if (my_cpu_num == 0) {
+			budget_start();
+		}
+
+		/* Time the test kernels between 1 MB and the relocated code */
+		if (bench) {
+			bench_run(my_cpu_ord, act_cpus, win0_start << 12,
+				high_test_adr - (win0_start << 12));
+		}
+
+		/* Find the DRAM map in the same memory, with one CPU so the
+		 * others don't upset the timing */
+		if (my_cpu_ord == 0) {
+			dram_find(win0_start << 12,
+				high_test_adr - (win0_start << 12));
+		}
+		barrier();
 	}
 
 	/* Set the initialized flag only after all of the CPU's have
@@ -566,6 +732,11 @@ void test_start(void)
 	btrace(my_cpu_num, __LINE__, "Start Done", 1, 0, 0);
 	start_seq = 2;
 
+	/* Start timing the current test */
+	if (my_cpu_ord == mstr_cpu) {
+		stat_mark(c_iter);
+	}
+
 	/* Loop through all tests */
 	while (1) {
 
@@ -584,23 +755,22 @@ void test_start(void)
 #endif
 	    test_setup();
 
-	    /* Loop through all possible windows */
-	    while (win_next <= ((ulong)v->pmap[v->msegs-1].end + WIN_SZ)) {
+	    /* Loop through the windows that have memory to test */
+	    while (window < win_cnt) {
 
 			/* Main scheduling barrier */
 			cprint(8, my_cpu_num+7, "W");
 			btrace(my_cpu_num, __LINE__, "Sched_Barr", 1,window,win_next);
 			barrier();
 
-			/* Don't go over the 8TB PAE limit */
-			if (win_next > MAX_MEM) {
-				break;
-			}
-
 			/* For the bit fade test, #11, we cannot relocate so bump the
-			 * window to 1 */
-			if (tseq[test].pat == 11 && window == 0) {
+			 * window to 1.  Also skip window 0 if it is not needed. */
+			if (window == 0 && (tseq[test].pat == 11 ||
+					win_plan[0].start >= win_plan[0].end)) {
 				window = 1;
+				if (window >= win_cnt) {
+					break;
+				}
 			}
 
 			/* Relocate if required */
@@ -608,9 +778,6 @@ void test_start(void)
 				btrace(my_cpu_num, __LINE__, "Sched_RelL", 1,0,0);
 				run_at(LOW_TEST_ADR, my_cpu_num);
 				}
-			if (window == 0 && v->plim_lower >= win0_start) {
-				window++;
-			}
 			if (window == 0 && (ulong)&_start == LOW_TEST_ADR) {
 				btrace(my_cpu_num, __LINE__, "Sched_RelH", 1,0,0);
 				run_at(high_test_adr, my_cpu_num);
@@ -658,6 +825,16 @@ void test_start(void)
 					run_cpus = tseq[test].cpu_sel;
 				}
 				}
+				break;
+			case CPM_ROTATE:
+				/* All CPUs at once, each on its own chunk.  The
+				 * chunks rotate between the CPUs for each sub-pass */
+				if (my_cpu_ord >= find_cpus(test)) {
+					run = 0;
+				}
+				mstr_cpu = find_cpus(test)-1;
+				run_cpus = find_cpus(test);
+				break;
 			}
 			btrace(my_cpu_num, __LINE__, "Sched_CPU1",1,run_cpus,run);
 			barrier();
@@ -684,31 +861,22 @@ void test_start(void)
 	 		}
 
 			if (my_cpu_ord == mstr_cpu) {
-				switch (window) {
-				/* Special case for relocation */
-				case 0:
-				winx.start = 0;
-				winx.end = win1_end;
-				window++;
-				break;
-				/* Special case for first segment */
-				case 1:
-				winx.start = win0_start;
-				winx.end = WIN_SZ;
-				win_next = WIN_SZ;
-				window++;
-				break;
-				/* For all other windows */
-				default:
-				winx.start = win_next;
-				win_next += WIN_SZ;
-				winx.end = win_next;
-				}
+				w = window;
+				wn = win_next;
+				plan_window(&wp, &w, &wn);
+				winx = wp;
+				window = w;
+				win_next = wn;
 				btrace(my_cpu_num,__LINE__,"Sched_Win1",1,winx.start,
 					winx.end);
 
 					/* Find the memory areas to test */
 					segs = compute_segments(winx, my_cpu_num);
+
+				/* The relocated code shares window 0 with the
+				 * memory under test, keep it write back */
+				set_memtype((ulong)&_start == LOW_TEST_ADR ?
+					memtype : MT_WB);
 			}
 			s_barrier();
 			btrace(my_cpu_num,__LINE__,"Sched_Win2",1,segs,
@@ -725,9 +893,23 @@ void test_start(void)
 				break;
 			}
 
+			/* Every CPU has to be done with the cache before the
+			 * memory under test is used without it */
+			if (get_memtype() != MT_WB) {
+				s_barrier();
+			}
+
 			btrace(my_cpu_num, __LINE__, "Strt_Test ",1,my_cpu_num,
 				my_cpu_ord);
+			stat_start(my_cpu_ord);
+			pmu_start();
 			do_test(my_cpu_ord);
+			pmu_stop();
+			stat_stop(my_cpu_ord);
+
+			/* Give the background bit fade a turn while its window
+			 * is mapped */
+			fade_window(my_cpu_ord, winx.start, winx.end);
 			btrace(my_cpu_num, __LINE__, "End_Test  ",1,my_cpu_num,
 				my_cpu_ord);
 
@@ -748,6 +930,17 @@ void test_start(void)
 		continue;
 	    }
 		
+		/* Charge the elapsed time to this test */
+		stat_mark(c_iter);
+
+		/* Show how fast the row hammer and the stress test were */
+		if (tseq[test].pat == 12) {
+			hammer_report();
+		}
+		if (tseq[test].pat == 13) {
+			stress_report();
+		}
+
 		// Check for user input
 		check_input();
 
@@ -796,6 +989,16 @@ void test_start(void)
 				} else {
 				next_test();
 			}
+			break;
+			case CPM_ROTATE:
+				/* Repeat until every CPU has tested every chunk */
+				if (++cpu_sel >= find_turns(test)) {
+					cpu_sel = 0;
+					next_test();
+				} else {
+					continue;
+				}
+				break;
 			}
 		}
 	    btrace(my_cpu_num, __LINE__, "Next_CPU  ",1,cpu_sel,test);
@@ -813,15 +1016,33 @@ void test_start(void)
 		dprint(LINE_INFO, 57, v->pass, 5, 0);
 		find_ticks_for_pass();
 		ltest = -1;
-		if (v->ecount == 0) {
-		    /* If onepass is enabled and we did not get any errors
-		     * reboot to exit the test */
-		    if (onepass) {
+		if (v->ecount == 0 && !onepass && !btflag) {
+		    cprint(LINE_MSG, COL_MSG,
+			"Pass complete, no errors, press Esc to exit");
+		}
+		stat_report();
+		pmu_report();
+		/* If onepass is enabled and we did not get any errors
+		 * reboot to exit the test */
+		if (v->ecount == 0 && onepass) {
+		    reboot();
+		}
+		/* When the time budget is used up exit the same way as
+		 * onepass if there were no errors, otherwise go on with the
+		 * normal test sequence as onepass does */
+		if (budget_min && budget_over()) {
+		    if (v->ecount == 0) {
 			reboot();
 		    }
-		    if (!btflag) cprint(LINE_MSG, COL_MSG,
-			"Pass complete, no errors, press Esc to exit");
+		    cprint(LINE_MSG, COL_MSG,
+			"Time budget used up, continuing the tests  ");
+		    budget_min = 0;
+		    test = -1;
+		    next_test();
+		    pass_flag = 0;
+		    find_ticks_for_pass();
 		}
+		budget_report();
 	    }
 
 	    bail=0;
@@ -837,12 +1058,7 @@ void test_setup()
 	ltest = test;
 
 	/* Now setup the test parameters based on the current test number */
-	if (v->pass == 0) {
-		/* Reduce iterations for first pass */
-		c_iter = tseq[test].iter/3;
-	} else {
-		c_iter = tseq[test].iter;
-	}
+	c_iter = find_iter(test, v->pass);
 
 	/* Set the number of iterations. We only do half of the iterations */
         /* on the first pass */
@@ -859,15 +1075,122 @@ void test_setup()
 }
 
 /* A couple static variables for when all cpus share the same pattern */
-static ulong sp1, sp2;
+static ulong sp1, sp2, spn;
+
+/*
+ * Pass fusion.  The last pass of a moving inversions test writes the
+ * fill pattern of the next test, so the next test can skip its fill.
+ * fuse_map has a bit for each window that was left holding fuse_pat.
+ * Any test on a window clears its bit.
+ */
+static ulong fuse_map[MAX_MEM / WIN_SZ / 32 + 1];
+static ulong fuse_pat, fuse_fade;
+static volatile int fuse_in, fuse_out;
+static volatile ulong fuse_pn;
+
+static void fuse_reset(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(fuse_map)/sizeof(fuse_map[0]); i++) {
+		fuse_map[i] = 0;
+	}
+}
+
+/* The pattern a test starts by filling memory with */
+static int first_fill(int tst, ulong *pat)
+{
+	switch(tseq[tst].pat) {
+	case 3:
+	case 4:
+		*pat = 0;
+		return 1;
+	case 5:
+		*pat = 0x80808080;
+		return 1;
+	}
+	return 0;
+}
+
+/* Guess the test that runs next, -1 if we don't know */
+static int fuse_next_test(void)
+{
+	int nt;
+
+	if (cpu_mode == CPM_ROTATE && cpu_sel + 1 < find_turns(test)) {
+		return test;
+	}
+	if ((cpu_mode == CPM_SEQ || (cpu_mode == CPM_ALL &&
+			tseq[test].cpu_sel == -1)) && cpu_sel + 1 < act_cpus) {
+		return test;
+	}
+	if ((nt = find_next_test(test)) < 0) {
+		nt = find_next_test(-1);
+	}
+	return nt;
+}
+
+/*
+ * Decide if this test can skip its first fill and if it should leave the
+ * fill pattern of the next test in memory.  Called by the master CPU.
+ */
+static void fuse_setup(void)
+{
+	int w, nt;
+	ulong pat;
+
+	fuse_in = fuse_out = 0;
+
+	/* Not when relocated or when the bit fade region has moved */
+	if ((ulong)&_start > LOW_TEST_ADR || c_iter < 1) {
+		return;
+	}
+	if (fuse_fade != fade_lo) {
+		fuse_reset();
+		fuse_fade = fade_lo;
+	}
+	w = winx.start / WIN_SZ;
+	if (fuse_map[w/32] & (1 << (w%32))) {
+		if (first_fill(test, &pat) && pat == fuse_pat) {
+			fuse_in = FUSE_IN;
+		}
+		fuse_map[w/32] &= ~(1 << (w%32));
+	}
+	if ((nt = fuse_next_test()) >= 0 && first_fill(nt, &pat)) {
+		fuse_pn = pat;
+		fuse_out = FUSE_OUT;
+	}
+}
+
+/* The test is done with this window, remember what it left there */
+static void fuse_done(void)
+{
+	int w;
+
+	if (!fuse_out) {
+		return;
+	}
+	if (fuse_pat != fuse_pn) {
+		fuse_reset();
+		fuse_pat = fuse_pn;
+	}
+	w = winx.start / WIN_SZ;
+	fuse_map[w/32] |= 1 << (w%32);
+}
 
 int do_test(int my_ord)
 {
-	int i=0, j=0;
-	static int bitf_sleep;
-	unsigned long p0=0, p1=0, p2=0;
+	int i=0, j=0, fi, fo;
+	static volatile int bitf_sleep;
+	unsigned long p0=0, p1=0, p2=0, pn;
+
+	/* Passes inside a test are fused when there are any up and down
+	 * passes, the first fill and the last pass depend on fuse_setup */
+	fi = c_iter > 0 ? FUSE_IN : 0;
+	fo = c_iter > 0 ? FUSE_OUT : 0;
 
 	if (my_ord == mstr_cpu) {
+		fuse_setup();
 	    if ((ulong)&_start > LOW_TEST_ADR) {
 		/* Relocated so we need to test all selected lower memory */
 
@@ -903,16 +1226,25 @@ int do_test(int my_ord)
 	/* Do the testing according to the selected pattern */
 
 	case 0: /* Address test, walking ones (test #0) */
-		/* Run with cache turned off */
-		set_cache(0);
+		/* Run with cache turned off, unless the test can flush
+		 * the lines it uses */
+		if (!addr_flush_ok()) {
+			set_cache(0);
+		}
 		addr_tst1(my_ord);
-		set_cache(1);
+		if (!addr_flush_ok()) {
+			set_cache(1);
+		}
+		BAILOUT;
+		break;
+
+	case 1: /* Address test, own address (test #1) */
+		addr_tst2(my_ord, 1);
 		BAILOUT;
 		break;
 
-	case 1:
-	case 2: /* Address test, own address (test #1, 2) */
-		addr_tst2(my_ord);
+	case 2: /* Address test, own address, all CPUs on all memory (test #2) */
+		addr_tst2(my_ord, 0);
 		BAILOUT;
 		break;
 
@@ -921,12 +1253,12 @@ int do_test(int my_ord)
 		p1 = 0;
 		p2 = ~p1;
 		s_barrier();
-		movinv1(c_iter,p1,p2,my_ord);
+		movinv1(c_iter,p1,p2,fuse_in | fo,p2,my_ord);
 		BAILOUT;
 	
 		/* Switch patterns */
 		s_barrier();
-		movinv1(c_iter,p2,p1,my_ord);
+		movinv1(c_iter,p2,p1,fi | fuse_out,fuse_pn,my_ord);
 		BAILOUT;
 		break;
 		
@@ -935,13 +1267,20 @@ int do_test(int my_ord)
 		for (i=0; i<8; i++, p0=p0>>1) {
 			p1 = p0 | (p0<<8) | (p0<<16) | (p0<<24);
 			p2 = ~p1;
+			pn = (p1 >> 1) & 0x7f7f7f7f;
 			s_barrier();
-			movinv1(c_iter,p1,p2, my_ord);
+			movinv1(c_iter,p1,p2, (i ? fi : fuse_in) | fo, p2,
+				my_ord);
 			BAILOUT;
 	
-			/* Switch patterns */
+			/* Switch patterns, then go on to the next pattern */
 			s_barrier();
-			movinv1(c_iter,p2,p1, my_ord);
+			if (i < 7) {
+				movinv1(c_iter,p2,p1, fi | fo, pn, my_ord);
+			} else {
+				movinv1(c_iter,p2,p1, fi | fuse_out, fuse_pn,
+					my_ord);
+			}
 			BAILOUT
 		}
 		break;
@@ -961,11 +1300,23 @@ int do_test(int my_ord)
 		s_barrier();
 		for (i=0; i < c_iter; i++) {
 			if (my_ord == mstr_cpu) {
-				sp1 = rand(0);
+				sp1 = i ? spn : rand(0);
 				sp2 = ~p1;
+
+				/* Pick the next pattern now so this one can
+				 * end by writing it */
+				if (i < c_iter-1) {
+					spn = rand(0);
+				}
 			}
 			s_barrier();
-			movinv1(2,sp1,sp2, my_ord);
+			if (i < c_iter-1) {
+				movinv1(2,sp1,sp2, (i ? FUSE_IN : 0) | FUSE_OUT, spn,
+					my_ord);
+			} else {
+				movinv1(2,sp1,sp2, (i ? FUSE_IN : 0) | fuse_out,
+					fuse_pn, my_ord);
+			}
 			BAILOUT;
 		}
 		break;
@@ -1017,12 +1368,18 @@ int do_test(int my_ord)
 		switch(bitf_seq) {
 		case 0:	/* Fill all of memory 0's */
 			bit_fade_fill(0, my_ord);
-			bitf_sleep = 1;
+			if (my_ord == mstr_cpu) {
+				bitf_sleep = 1;
+			}
 			break;
 		case 1: /* Sleep for the specified time */
-			/* Only sleep once */
+			/* Only sleep once, every CPU reads the flag before
+			 * the master clears it after the barrier */
 			if (bitf_sleep) {
 				sleep(c_iter, 1, my_ord);
+			}
+			s_barrier();
+			if (my_ord == mstr_cpu) {
 				bitf_sleep = 0;
 			}
 			break;
@@ -1031,12 +1388,17 @@ int do_test(int my_ord)
 			break;
 		case 3:	/* Fill all of memory 1's */
 			bit_fade_fill(-1, my_ord);
-			bitf_sleep = 1;
+			if (my_ord == mstr_cpu) {
+				bitf_sleep = 1;
+			}
 			break;
 		case 4: /* Sleep for the specified time */
-			/* Only sleep once */
+			/* Only sleep once, as above */
 			if (bitf_sleep) {
 				sleep(c_iter, 1, my_ord);
+			}
+			s_barrier();
+			if (my_ord == mstr_cpu) {
 				bitf_sleep = 0;
 			}
 			break;
@@ -1047,6 +1409,21 @@ int do_test(int my_ord)
 		BAILOUT;
 		break;
 
+	case 12: /* Row hammer (test #11) */
+		hammer(c_iter, my_ord);
+		BAILOUT;
+		break;
+
+	case 13: /* Stress, for a set time (test #12) */
+		stress(my_ord);
+		BAILOUT;
+		break;
+
+	case 14: /* Cross CPU write and check (test #13) */
+		cross_cpu(c_iter, my_ord);
+		BAILOUT;
+		break;
+
 	case 90: /* Modulo 20 check, all ones and zeros (unused) */
 		p1=0;
 		for (i=0; i<MOD_SZ; i++) {
@@ -1080,45 +1457,40 @@ int do_test(int my_ord)
 		}
 		break;
 	}
+	if (my_ord == mstr_cpu) {
+		fuse_done();
+	}
 	return(0);
 }
 
 /* Compute number of SPINSZ chunks being tested */
 int find_chunks(int tst) 
 {
-	int i, j, sg, wmax, ch;
+	int i, w, sg, ch;
 	struct pmap twin={0,0};
-	unsigned long wnxt = WIN_SZ;
+	unsigned long wnxt = 0;
 	unsigned long len;
 
-	wmax = MAX_MEM/WIN_SZ+2;  /* The number of segments +2 */
 	/* Compute the number of SPINSZ memory segments */
 	ch = 0;
-	for(j = 0; j < wmax; j++) {
-		/* special case for relocation */
-		if (j == 0) {
-			twin.start = 0;
-			twin.end = win1_end;
-		}
-
-		/* special case for first window */
-		if (j == 1) {
-			twin.start = win0_start;
-			twin.end = WIN_SZ;
-		}
-
-		/* For all other windows */
-		if (j > 1) {
-			twin.start = wnxt;
-			wnxt += WIN_SZ;
-			twin.end = wnxt;
+	w = 0;
+	while (w < win_cnt) {
+		if (w == 0 && win_plan[0].start >= win_plan[0].end) {
+			w = 1;
+			continue;
 		}
+		plan_window(&twin, &w, &wnxt);
 
 	        /* Find the memory areas I am going to test */
 		sg = compute_segments(twin, -1);
 		for(i = 0; i < sg; i++) {
 			len = v->map[i].end - v->map[i].start;
 
+			/* In rotated mode all but test #2 are split up */
+			if (cpu_mode == CPM_ROTATE && tseq[tst].pat != 2) {
+				len /= find_cpus(tst);
+			}
+
 			if (cpu_mode == CPM_ALL && act_cpus > 1) {
 				switch(tseq[tst].pat) {
 				case 2:
@@ -1127,6 +1499,9 @@ int find_chunks(int tst)
 				case 6:
 				case 9:
 				case 10:
+				case 11:
+				case 12:
+				case 14:
 				    len /= act_cpus;
 				    break;
 				case 7:
@@ -1141,6 +1516,26 @@ int find_chunks(int tst)
 	return(ch);
 }
 
+/* Number of CPUs that run a test at once in rotated mode */
+static int find_cpus(int tst)
+{
+	if (tseq[tst].cpu_sel == -1 || tseq[tst].cpu_sel > act_cpus) {
+		return act_cpus;
+	}
+	return tseq[tst].cpu_sel;
+}
+
+/* Number of times a test is repeated in rotated mode.  The bit fade
+ * does not gain anything from testing each chunk with each CPU, and the
+ * parallel address test has every CPU on all of memory already. */
+static int find_turns(int tst)
+{
+	if (tseq[tst].pat == 11 || tseq[tst].pat == 2) {
+		return 1;
+	}
+	return find_cpus(tst);
+}
+
 /* Compute the total number of ticks per pass */
 void find_ticks_for_pass(void)
 {
@@ -1173,13 +1568,7 @@ static int find_ticks_for_test(int tst)
 	/* Determine the number of chunks for this test */
 	ch = find_chunks(tst);
 
-	/* Set the number of iterations. We only do 1/3 of the iterations */
-        /* on the first pass */
-	if (v->pass == 0) {
-		c = tseq[tst].iter/3;
-	} else {
-		c = tseq[tst].iter;
-	}
+	c = find_iter(tst, v->pass);
 
 	switch(tseq[tst].pat) {
 	case 0: /* Address test, walking ones */
@@ -1192,12 +1581,21 @@ static int find_ticks_for_test(int tst)
 	case 3: /* Moving inversions, all ones and zeros */
 	case 4:
 		ticks = 2 + 4 * c;
+		if (pipeline) {
+			ticks = 2 * (ch + 2 * c);
+		}
 		break;
 	case 5: /* Moving inversions, 8 bit walking ones and zeros */
 		ticks = 16 + 32 * c;
+		if (pipeline) {
+			ticks = 16 * (ch + 2 * c);
+		}
 		break;
 	case 6: /* Random Data */
 		ticks = c + 4 * c;
+		if (pipeline) {
+			ticks = c * (ch + 4);
+		}
 		break;
 	case 7: /* Block move */
 		ticks = (ch + ch/act_cpus + c*ch);
@@ -1214,6 +1612,15 @@ static int find_ticks_for_test(int tst)
 	case 11: /* Bit fade test */
 		ticks = c * 2 + 4 * ch;
 		break;
+	case 12: /* Row hammer */
+		ticks = 2;
+		break;
+	case 13: /* Stress, one tick a second */
+		ticks = stress_time() + 2 * ch;
+		break;
+	case 14: /* Cross CPU write and check */
+		ticks = c;
+		break;
 	case 90: /* Modulo 20 check, all ones and zeros (unused) */
 		ticks = (2 + c) * 40;
 		break;
@@ -1221,19 +1628,227 @@ static int find_ticks_for_test(int tst)
 		ticks = (2 + c) * 40 * 8;
 		break;
 	}
-	if (cpu_mode == CPM_SEQ || tseq[tst].cpu_sel == -1) {
+	if (cpu_mode == CPM_ROTATE) {
+		ticks *= find_turns(tst);
+	} else if (cpu_mode == CPM_SEQ || tseq[tst].cpu_sel == -1) {
 		ticks *= act_cpus;
 	}
-	if (tseq[tst].pat == 0 || tseq[tst].pat == 7 || tseq[tst].pat == 11) {
+	if (tseq[tst].pat == 0 || tseq[tst].pat == 7 || tseq[tst].pat == 11 ||
+			tseq[tst].pat == 13) {
+		return ticks;
+	}
+	/* The pipelined tests already count the chunks */
+	if (pipeline && tseq[tst].pat >= 3 && tseq[tst].pat <= 6) {
 		return ticks;
 	}
 	return ticks*ch;
 }
 
+/*
+ * Number of iterations for a test.  We only do 1/3 of the iterations on
+ * the first pass.  With a time budget the plan sets the iterations.
+ */
+int find_iter(int tst, int pass)
+{
+	if (budget_min) {
+		return budget_iter(tst);
+	}
+	if (pass == 0) {
+		return tseq[tst].iter/3;
+	}
+	return tseq[tst].iter;
+}
+
+/*
+ * Estimate the number of bytes read and written by a test with c
+ * iterations.  This only needs to be roughly right, the estimate is
+ * corrected by what was actually measured.
+ */
+unsigned long long find_bytes_for_test(int tst, int c)
+{
+	unsigned long long mem, n;
+
+	if (tseq[tst].sel == 0) {
+		return 0;
+	}
+	mem = (unsigned long long)v->selected_pages << 12;
+
+	switch(tseq[tst].pat) {
+	case 0: /* Address test, walking ones */
+		n = mem >> 8;
+		break;
+	case 1: /* Address test, own address */
+	case 2:
+		n = mem * 2;
+		break;
+	case 3: /* Moving inversions, all ones and zeros */
+	case 4:
+		n = mem * 2 * (1 + 4 * c);
+		break;
+	case 5: /* Moving inversions, 8 bit walking ones and zeros */
+		n = mem * 16 * (1 + 4 * c);
+		break;
+	case 6: /* Random Data */
+		n = mem * 9 * c;
+		break;
+	case 7: /* Block move */
+		n = mem * (2 + 2 * c);
+		break;
+	case 8: /* Moving inversions, 32 bit shifting pattern */
+		n = mem * 64 * (1 + 4 * c);
+		break;
+	case 9: /* Random Data Sequence */
+		n = mem * 5 * c;
+		break;
+	case 10: /* Modulo 20 check, Random pattern */
+		n = mem * 80 * c;
+		break;
+	case 11: /* Bit fade test */
+		n = mem * 4;
+		break;
+	case 12: /* Row hammer, fill and check plus the pairs */
+		n = mem * 4 + ((mem >> 2) / SPINSZ + 1) * c * 2 *
+			HAM_LOOPS * 128;
+		break;
+	case 14: /* Cross CPU write and check */
+		n = mem * 2 * c;
+		break;
+	default:
+		n = 0;
+		break;
+	}
+	if (cpu_mode == CPM_SEQ || (cpu_mode == CPM_ALL && tseq[tst].cpu_sel == -1)) {
+		n *= act_cpus;
+	} else if (cpu_mode == CPM_ROTATE) {
+		n *= find_turns(tst);
+	}
+	return n;
+}
+
+/* Seconds that a test with c iterations spends sleeping, or running
+ * for a set time */
+ulong find_sleep_for_test(int tst, int c)
+{
+	if (tseq[tst].sel == 0) {
+		return 0;
+	}
+	if (tseq[tst].pat == 13) {
+		return stress_time();
+	}
+	if (tseq[tst].pat != 11) {
+		return 0;
+	}
+	return 2 * c;
+}
+
+/* Find the test that runs after tst in this pass, -1 if it is the last */
+int find_next_test(int tst)
+{
+	if (budget_min) {
+		return budget_after(tst);
+	}
+	for (tst++; tseq[tst].cpu_sel != 0; tst++) {
+		if (tseq[tst].sel) {
+			return tst;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Build the plan of windows to test from the memory map and the selected
+ * address range.  Entry 0 is the relocation window, it is left empty when
+ * it is not needed.  The other entries are spans of whole windows that
+ * have memory in them so the holes in the memory map are skipped.  This
+ * must be called whenever the memory map or the address range changes.
+ */
+void compute_windows(void)
+{
+	ulong start, end;
+	int i, n;
+
+	/* The windows have moved, nothing is left in memory */
+	fuse_reset();
+
+	win_plan[0].start = 0;
+	win_plan[0].end = 0;
+	end = win1_end < v->plim_upper ? win1_end : v->plim_upper;
+	if (v->plim_lower < win0_start) {
+		for (i = 0; i < v->msegs; i++) {
+			if (v->pmap[i].start < end &&
+					v->pmap[i].end > v->plim_lower) {
+				win_plan[0].end = win1_end;
+				break;
+			}
+		}
+	}
+	for (i = 0, n = 1; i < v->msegs; i++) {
+		start = v->pmap[i].start;
+		end = v->pmap[i].end;
+		if (start < v->plim_lower) {
+			start = v->plim_lower;
+		}
+		if (start < win0_start) {
+			start = win0_start;
+		}
+		if (end > v->plim_upper) {
+			end = v->plim_upper;
+		}
+		if (start >= end || start > MAX_MEM) {
+			continue;
+		}
+
+		/* Round out to whole windows, window 1 starts at win0_start */
+		start &= ~(WIN_SZ-1);
+		if (start < win0_start) {
+			start = win0_start;
+		}
+		end = (end + WIN_SZ-1) & ~(WIN_SZ-1);
+
+		/* Join this to the last span if they touch */
+		if (n > 1 && start <= win_plan[n-1].end) {
+			if (end > win_plan[n-1].end) {
+				win_plan[n-1].end = end;
+			}
+		} else if (n < MAX_MEM_SEGMENTS+1) {
+			win_plan[n].start = start;
+			win_plan[n].end = end;
+			n++;
+		} else {
+			win_plan[n-1].end = end;
+		}
+	}
+	win_cnt = n;
+
+	/* The bit fade region has to be inside the range */
+	fade_move();
+}
+
+/*
+ * Get the next window from the plan.  The window ends at the next
+ * WIN_SZ boundary or at the end of the span.  Then w and next are
+ * advanced past it.
+ */
+static void plan_window(struct pmap *win, int *w, ulong *next)
+{
+	struct pmap *p = &win_plan[*w];
+
+	win->start = *next > p->start ? *next : p->start;
+	win->end = (win->start & ~(WIN_SZ-1)) + WIN_SZ;
+	if (win->end >= p->end) {
+		win->end = p->end;
+		(*w)++;
+		*next = 0;
+	} else {
+		*next = win->end;
+	}
+}
+
 static int compute_segments(struct pmap win, int me)
 {
 	unsigned long wstart, wend;
-	int i, sg;
+	int i, sg, n;
+	struct pmap pm[MAX_MEM_SEGMENTS+1];
 
 	/* Compute the window I am testing memory in */
 	wstart = win.start;
@@ -1250,11 +1865,12 @@ static int compute_segments(struct pmap win, int me)
 	if (wstart >= wend) {
 		return(0);
 	}
-	/* List the segments being tested */
-	for (i=0; i< v->msegs; i++) {
+	/* List the segments being tested, without the bit fade region */
+	n = fade_exclude(pm);
+	for (i=0; i< n; i++) {
 		unsigned long start, end;
-		start = v->pmap[i].start;
-		end = v->pmap[i].end;
+		start = pm[i].start;
+		end = pm[i].end;
 		if (start <= wstart) {
 			start = wstart;
 		}
@@ -0,0 +1,329 @@
+/* mtrr.c - MemTest-86  Version 4.1
+ *
+ * Check that the memory being tested is write back in the MTRRs.  RAM
+ * that the firmware left uncached or write through is reported since
+ * the tests run much slower on it.  With the "mtrrfix" option the
+ * variable MTRRs that only cover RAM are changed to write back.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "msr.h"
+#include "smp.h"
+
+extern struct cpu_ident cpu_id;
+extern short mtrrfix;
+
+#define MSR_MTRR_CAP		0xfe
+#define MSR_MTRR_DEF_TYPE	0x2ff
+#define MSR_MTRR_BASE(n)	(0x200 + 2*(n))
+#define MSR_MTRR_MASK(n)	(0x201 + 2*(n))
+#define MSR_MTRR_FIX64K		0x250
+#define MSR_MTRR_FIX16K		0x258
+#define MSR_MTRR_FIX4K		0x268
+
+#define MTRR_UC		0
+#define MTRR_WC		1
+#define MTRR_WT		4
+#define MTRR_WP		5
+#define MTRR_WB		6
+
+#define MTRR_MAX	16
+#define MTRR_REPORT	8	/* Ranges to list on the screen */
+
+static struct {
+	ulong base_lo, base_hi;
+	ulong mask_lo, mask_hi;
+	ulong base, mask;		/* In pages */
+} var[MTRR_MAX];
+static int nvar;
+static ulong def_type;
+static unsigned char fix[256];		/* Type of each page below 1 MB */
+static int fix_on;
+static int fix_cnt;			/* Variable MTRRs changed */
+
+/* The effective type of a page */
+static int mtrr_type(ulong p)
+{
+	int i, t = -1, vt;
+
+	if (!(def_type & 0x800)) {
+		return MTRR_UC;
+	}
+	if (p < 0x100 && fix_on) {
+		return fix[p];
+	}
+	for (i = 0; i < nvar; i++) {
+		if (!(var[i].mask_lo & 0x800) ||
+				(p & var[i].mask) != (var[i].base & var[i].mask)) {
+			continue;
+		}
+		vt = var[i].base_lo & 0xff;
+		if (vt == MTRR_UC) {
+			return MTRR_UC;
+		}
+		if (t < 0 || (t == MTRR_WB && vt == MTRR_WT)) {
+			t = vt;
+		}
+	}
+	return t < 0 ? (def_type & 0xff) : t;
+}
+
+/* The next page after p where the type could change */
+static ulong mtrr_next(ulong p)
+{
+	ulong n = ~0UL, b, e;
+	int i;
+
+	if (p < 0x100 && fix_on) {
+		return p + 1;
+	}
+	for (i = 0; i < nvar; i++) {
+		if (!(var[i].mask_lo & 0x800)) {
+			continue;
+		}
+		b = var[i].base & var[i].mask;
+		e = b + (var[i].mask & -var[i].mask);
+		if (b > p && b < n) {
+			n = b;
+		}
+		if (e > p && e < n) {
+			n = e;
+		}
+	}
+	return n;
+}
+
+static void mtrr_read(void)
+{
+	ulong lo, hi, b, sz, k;
+	int i, j;
+
+	rdmsr(MSR_MTRR_CAP, lo, hi);
+	nvar = lo & 0xff;
+	if (nvar > MTRR_MAX) {
+		nvar = MTRR_MAX;
+	}
+	rdmsr(MSR_MTRR_DEF_TYPE, def_type, hi);
+	for (i = 0; i < nvar; i++) {
+		rdmsr(MSR_MTRR_BASE(i), var[i].base_lo, var[i].base_hi);
+		rdmsr(MSR_MTRR_MASK(i), var[i].mask_lo, var[i].mask_hi);
+		var[i].base = (var[i].base_hi << 20) | (var[i].base_lo >> 12);
+		var[i].mask = (var[i].mask_hi << 20) | (var[i].mask_lo >> 12);
+	}
+
+	/* The fixed MTRRs cover the first 1 MB */
+	fix_on = (lo & 0x100) && (def_type & 0x400);
+	if (!fix_on) {
+		return;
+	}
+	for (i = 0; i < 11; i++) {
+		/* One 64K, two 16K and eight 4K MSRs, each with 8 types */
+		if (i == 0) {
+			rdmsr(MSR_MTRR_FIX64K, lo, hi);
+			b = 0;
+			sz = 16;
+		} else if (i < 3) {
+			rdmsr(MSR_MTRR_FIX16K + i - 1, lo, hi);
+			b = 0x80 + (i - 1) * 0x20;
+			sz = 4;
+		} else {
+			rdmsr(MSR_MTRR_FIX4K + i - 3, lo, hi);
+			b = 0xc0 + (i - 3) * 8;
+			sz = 1;
+		}
+		for (j = 0; j < 8; j++) {
+			for (k = 0; k < sz; k++) {
+				fix[b + j*sz + k] = j < 4 ? lo >> (j*8) :
+					hi >> ((j-4)*8);
+			}
+		}
+	}
+}
+
+static char *type_name(int t)
+{
+	switch(t) {
+	case MTRR_UC:
+		return "uncached";
+	case MTRR_WC:
+		return "write combining";
+	case MTRR_WT:
+		return "write through";
+	case MTRR_WP:
+		return "write protect";
+	}
+	return "reserved type";
+}
+
+/* List a range of RAM that is not write back */
+static void mtrr_show(ulong start, ulong end, int t, int *shown)
+{
+	int y;
+
+	if (*shown >= MTRR_REPORT || (y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "MTRR: RAM       -       is");
+	aprint(y, 10, start);
+	aprint(y, 18, end);
+	cprint(y, 27, type_name(t));
+	(*shown)++;
+}
+
+/* Is all of the range in the memory map */
+static int all_ram(ulong b, ulong e)
+{
+	int i;
+
+	for (i = 0; i < v->msegs; i++) {
+		if (b >= v->pmap[i].start && e <= v->pmap[i].end) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Work out which variable MTRRs can be made write back.  Only MTRRs
+ * that cover nothing but RAM are changed, so MMIO stays uncached.
+ */
+static void mtrr_plan(void)
+{
+	ulong b, e;
+	int i, t;
+
+	for (i = 0; i < nvar; i++) {
+		t = var[i].base_lo & 0xff;
+		if (!(var[i].mask_lo & 0x800) || t == MTRR_WB) {
+			continue;
+		}
+		b = var[i].base & var[i].mask;
+		e = b + (var[i].mask & -var[i].mask);
+		if (!all_ram(b, e)) {
+			continue;
+		}
+		if ((def_type & 0xff) == MTRR_WB) {
+			var[i].mask_lo &= ~0x800;
+		} else {
+			var[i].base_lo = (var[i].base_lo & ~0xff) | MTRR_WB;
+		}
+		fix_cnt++;
+	}
+}
+
+/*
+ * Compare the MTRRs with the memory map and report the RAM that is not
+ * write back.  Called by the boot CPU at startup.
+ */
+void mtrr_audit(void)
+{
+	ulong p, n, e, start = 0, bad = 0;
+	int i, t, y, cur, shown = 0;
+
+	if (!cpu_id.fid.bits.mtrr || !cpu_id.fid.bits.msr) {
+		return;
+	}
+	mtrr_read();
+	for (i = 0; i < v->msegs; i++) {
+		cur = MTRR_WB;
+		e = v->pmap[i].end;
+		for (p = v->pmap[i].start; p < e; p = n) {
+			n = mtrr_next(p);
+			if (n > e) {
+				n = e;
+			}
+			t = mtrr_type(p);
+			if (t != cur) {
+				if (cur != MTRR_WB) {
+					mtrr_show(start, p, cur, &shown);
+				}
+				start = p;
+				cur = t;
+			}
+			if (t != MTRR_WB) {
+				bad += n - p;
+			}
+		}
+		if (cur != MTRR_WB) {
+			mtrr_show(start, e, cur, &shown);
+		}
+	}
+	if (bad == 0) {
+		return;
+	}
+	if (!mtrrfix) {
+		if ((y = report_line()) >= 0) {
+			cprint(y, 0, "MTRR:       of RAM is not write back, "
+				"use mtrrfix to change it");
+			aprint(y, 6, bad);
+		}
+		return;
+	}
+	mtrr_plan();
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "MTRR:    variable MTRRs changed to write back");
+		dprint(y, 6, fix_cnt, 2, 0);
+	}
+}
+
+static void tlb_flush(void)
+{
+	ulong cr3;
+
+	asm __volatile__ (
+		"movl %%cr3,%0\n\t"
+		"movl %0,%%cr3"
+		: "=r" (cr3)
+		:
+		: "memory"
+	);
+}
+
+/*
+ * Write the changed MTRRs, every CPU has to do this.  It follows the
+ * sequence in the Intel SDM (11.11.8): all of the CPUs meet at a barrier,
+ * each one disables and flushes its caches and TLB, turns the MTRRs off,
+ * writes them, turns them back on and flushes again, then they all meet
+ * again so that no two CPUs ever disagree on a memory type.  Called by
+ * every CPU.
+ */
+void mtrr_apply(void)
+{
+	ulong lo, hi, cr4, flags;
+	int i;
+
+	if (fix_cnt == 0) {
+		return;
+	}
+	barrier();
+	asm __volatile__ ("pushfl; popl %0; cli" : "=r" (flags));
+
+	/* No fill cache mode, flush the caches and the TLB with global
+	 * pages turned off */
+	cache_off();
+	asm __volatile__ ("movl %%cr4,%0" : "=r" (cr4));
+	if (cr4 & 0x80) {
+		asm __volatile__ ("movl %0,%%cr4" : : "r" (cr4 & ~0x80));
+	}
+	tlb_flush();
+
+	rdmsr(MSR_MTRR_DEF_TYPE, lo, hi);
+	wrmsr(MSR_MTRR_DEF_TYPE, lo & ~0x800, hi);
+	for (i = 0; i < nvar; i++) {
+		wrmsr(MSR_MTRR_BASE(i), var[i].base_lo, var[i].base_hi);
+		wrmsr(MSR_MTRR_MASK(i), var[i].mask_lo, var[i].mask_hi);
+	}
+	wrmsr(MSR_MTRR_DEF_TYPE, lo, hi);
+
+	asm __volatile__ ("wbinvd");
+	tlb_flush();
+	cache_on();
+	if (cr4 & 0x80) {
+		asm __volatile__ ("movl %0,%%cr4" : : "r" (cr4));
+	}
+	asm __volatile__ ("pushl %0; popfl" : : "r" (flags) : "cc");
+	barrier();
+}
@@ -0,0 +1,232 @@
+/* pmu.c - MemTest-86  Version 4.1
+ *
+ * Per test hardware performance counters using the architectural
+ * performance monitoring unit (CPUID leaf 0xA).
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "smp.h"
+#include "msr.h"
+
+extern struct barrier_s *barr;
+extern struct tseq tseq[];
+extern volatile int test;
+extern short pmu_guest;
+
+#define MSR_PERF_GLOBAL_CTRL	0x38f
+
+/* Event select bits */
+#define EVT_USR		(1 << 16)
+#define EVT_OS		(1 << 17)
+#define EVT_EN		(1 << 22)
+
+/* Counters in the order they are displayed */
+#define PMU_CYCLES	0
+#define PMU_INSTR	1
+#define PMU_LLC_MISS	2
+#define PMU_STALLS	3
+
+static const struct {
+	ulong evtsel;		/* Event, umask and cmask */
+	int   avail_bit;	/* CPUID 0xA EBX bit, -1 if not architectural */
+} pmu_events[PMU_NCTR] = {
+	{ 0x003c, 0 },			/* Unhalted core cycles */
+	{ 0x00c0, 1 },			/* Instructions retired */
+	{ 0x412e, 4 },			/* LLC misses */
+	{ 0x140014a3, -1 },		/* CYCLE_ACTIVITY.STALLS_MEM_ANY */
+};
+
+/*
+ * The memory stall event is not architectural, this encoding is only
+ * right for the Skylake and Ice Lake based cores
+ */
+static int pmu_stalls_ok(void)
+{
+	int model;
+
+	if (cpu_id.vers.bits.family != 6) {
+		return 0;
+	}
+	model = (cpu_id.vers.bits.extendedModel << 4) | cpu_id.vers.bits.model;
+	switch (model) {
+	case 0x4e:		/* Skylake */
+	case 0x5e:
+	case 0x55:		/* Skylake and Cascade Lake server */
+	case 0x8e:		/* Kaby Lake, Coffee Lake */
+	case 0x9e:
+	case 0xa5:		/* Comet Lake */
+	case 0xa6:
+	case 0x6a:		/* Ice Lake server */
+	case 0x6c:
+	case 0x7d:		/* Ice Lake */
+	case 0x7e:
+	case 0x8c:		/* Tiger Lake */
+	case 0x8d:
+	case 0xa7:		/* Rocket Lake */
+		return 1;
+	}
+	return 0;
+}
+
+int pmu_nctr = 0;		/* Number of counters in use, 0 = no PMU */
+static int pmu_version;
+static uint64_t pmu_tst[MAX_TESTS][PMU_NCTR];
+
+/*
+ * Find out if we have a usable PMU and how many of our events it can count
+ */
+void pmu_setup(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	int i, n;
+
+	pmu_nctr = 0;
+	if (cpu_id.vend_id.char_array[0] != 'G' || cpu_id.max_cpuid < 0xa ||
+			!cpu_id.fid.bits.msr) {
+		return;
+	}
+
+	/* Hypervisors often report leaf 0xA and then fault on the MSRs, so
+	 * in a guest the PMU is only used with the "pmu" option */
+	if ((cpu_id.fid.uint32_array[1] & CPUID1_HYPERVISOR) && !pmu_guest) {
+		return;
+	}
+	cpuid(0xa, &eax, &ebx, &ecx, &edx);
+	pmu_version = eax & 0xff;
+	n = (eax >> 8) & 0xff;
+	if (pmu_version == 0 || n == 0 || ((eax >> 16) & 0xff) == 0) {
+		return;
+	}
+	if (n > PMU_NCTR) {
+		n = PMU_NCTR;
+	}
+
+	if (n == PMU_NCTR && !pmu_stalls_ok()) {
+		n--;
+	}
+
+	/* Stop at the first architectural event that is not supported */
+	for (i = 0; i < n; i++) {
+		if (pmu_events[i].avail_bit >= 0 &&
+				(ebx >> pmu_events[i].avail_bit) & 1) {
+			break;
+		}
+	}
+	pmu_nctr = i;
+}
+
+/*
+ * Program and start the counters on this CPU
+ */
+void pmu_start(void)
+{
+	int i;
+
+	if (pmu_nctr == 0) {
+		return;
+	}
+	for (i = 0; i < pmu_nctr; i++) {
+		wrmsr(MSR_P6_EVNTSEL0+i, 0, 0);
+		wrmsr(MSR_P6_PERFCTR0+i, 0, 0);
+	}
+	if (pmu_version >= 2) {
+		wrmsr(MSR_PERF_GLOBAL_CTRL, (1 << pmu_nctr) - 1, 0);
+	}
+	for (i = 0; i < pmu_nctr; i++) {
+		wrmsr(MSR_P6_EVNTSEL0+i,
+			pmu_events[i].evtsel | EVT_USR | EVT_OS | EVT_EN, 0);
+	}
+}
+
+/*
+ * Stop the counters on this CPU and add them to the current test
+ */
+void pmu_stop(void)
+{
+	ulong l, h;
+	uint64_t cnt[PMU_NCTR];
+	int i;
+
+	if (pmu_nctr == 0) {
+		return;
+	}
+	for (i = 0; i < pmu_nctr; i++) {
+		wrmsr(MSR_P6_EVNTSEL0+i, 0, 0);
+		rdpmc(i, l, h);
+		cnt[i] = ((uint64_t)h << 32) | l;
+	}
+	if (test >= MAX_TESTS) {
+		return;
+	}
+	spin_lock(&barr->mutex);
+	for (i = 0; i < pmu_nctr; i++) {
+		pmu_tst[test][i] += cnt[i];
+	}
+	spin_unlock(&barr->mutex);
+}
+
+/* Compute 100 * a / b with both values scaled to fit in 32 bits */
+static ulong pmu_ratio(uint64_t a, uint64_t b)
+{
+	while (b >> 32 || a >> 57) {
+		a >>= 1;
+		b >>= 1;
+	}
+	if (b == 0) {
+		return 0;
+	}
+	return udiv64(a * 100, b);
+}
+
+/*
+ * Display the counters for each test that ran in this pass and then
+ * clear them for the next pass
+ */
+void pmu_report(void)
+{
+	int i, y;
+	uint64_t *c;
+	ulong n;
+
+	if (pmu_nctr == 0) {
+		return;
+	}
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "Tst  Cycles(M)  Instr(M)   IPC  LLC-Miss(K)  Mem-Stall");
+	}
+	for (i = 0; tseq[i].msg != NULL && i < MAX_TESTS; i++) {
+		c = pmu_tst[i];
+		if (c[PMU_CYCLES] == 0) {
+			continue;
+		}
+		if ((y = report_line()) < 0) {
+			continue;
+		}
+		dprint(y, 0, i, 3, 0);
+		dprint(y, 5, udiv64(c[PMU_CYCLES], 1000000), 9, 0);
+		if (pmu_nctr > PMU_INSTR) {
+			dprint(y, 16, udiv64(c[PMU_INSTR], 1000000), 9, 0);
+			n = pmu_ratio(c[PMU_INSTR], c[PMU_CYCLES]);
+			dprint(y, 27, n / 100, 2, 0);
+			cprint(y, 29, ".");
+			dprint(y, 30, (n / 10) % 10, 1, 0);
+			dprint(y, 31, n % 10, 1, 0);
+		}
+		if (pmu_nctr > PMU_LLC_MISS) {
+			dprint(y, 34, udiv64(c[PMU_LLC_MISS], 1000), 9, 0);
+		}
+		if (pmu_nctr > PMU_STALLS) {
+			n = pmu_ratio(c[PMU_STALLS], c[PMU_CYCLES]);
+			dprint(y, 47, n, 3, 0);
+			cprint(y, 50, "%");
+		}
+	}
+	for (i = 0; i < MAX_TESTS; i++) {
+		for (y = 0; y < PMU_NCTR; y++) {
+			pmu_tst[i][y] = 0;
+		}
+	}
+}
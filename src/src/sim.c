@@ -0,0 +1,478 @@
+/* sim.c - MemTest-86  Version 4.1
+ *
+ * Fault simulator for the Linux build.  One fault at a time is put in a
+ * small simulated array and each test is run over it with the access
+ * pattern of test.c, to measure how likely the test is to find each kind
+ * of fault and how long it takes.  The inversion, modulo 20 and random
+ * number tests use the templates from kernel.h with the reads and writes
+ * sent through the fault model, the others are written out here.
+ *
+ * Time is counted in memory accesses.  The array stands in for 1 GB, so
+ * one access to it is scaled to the time a 1 GB pass takes at the given
+ * bandwidth, and the bit fade test waits the same number of seconds as
+ * it does in memtest.
+ *
+ *   memtest-linux sim=<trials> [simbw=<MB/s>] [tstlist=a,b,..]
+ *
+ * It is built into memtest-linux, which needs gcc with 32 bit support and
+ * the 32 bit C library, "make memtest-linux" checks for them first.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "linux.h"
+
+#define SIM_WORDS	16384		/* 64 KB */
+#define SIM_SCALE	((1 << 30) / (SIM_WORDS * 4))
+
+/* Fault models */
+#define FM_STUCK	0	/* Stuck at 0 or 1 */
+#define FM_TRANS	1	/* Can't make an up or a down transition */
+#define FM_COUPLE	2	/* A transition in one cell sets another */
+#define FM_ALIAS	3	/* Two addresses decode to the same word */
+#define FM_DECAY	4	/* Loses its charge some time after a write */
+#define FM_FLIP		5	/* Reads are sometimes wrong */
+#define FM_MAX		6
+
+extern struct tseq tseq[];
+void rand_seed(unsigned int seed1, unsigned int seed2, int me);
+ulong rand(int me);
+
+static ulong sim_mem[SIM_WORDS] __attribute__((aligned(SIM_WORDS * 4)));
+static unsigned long long sim_now;	/* Accesses so far */
+static unsigned long long sim_hit;	/* When the fault was found, 0 = not */
+static ulong acc_per_sec;
+static int trials, sim_bw = 4000;
+static ulong rnd_state;
+
+static char *fm_names[FM_MAX] = {
+	"stuck", "trans", "couple", "alias", "decay", "flip"
+};
+
+static struct {
+	int model;
+	ulong w, bit, val;	/* The faulty cell and its stuck or charged
+				 * value, or the transition it can't make */
+	ulong aw, abit, adir;	/* Coupling aggressor and its transition */
+	ulong alias;		/* The word that decodes to w */
+	ulong rate;		/* A read flips when (random & rate) == 0 */
+	unsigned long long hold, wtime;	/* Retention time, last write */
+} f;
+
+/* Xorshift, kept apart from rand() which the tests use */
+static ulong sim_rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static ulong sim_word(volatile ulong *a)
+{
+	ulong i = (ulong *)a - sim_mem;
+
+	sim_now++;
+	return i == f.alias ? f.w : i;
+}
+
+static ulong sim_ld(volatile ulong *a)
+{
+	ulong i = sim_word(a), v;
+
+	if (i != f.w) {
+		return sim_mem[i];
+	}
+	switch (f.model) {
+	case FM_STUCK:
+		return (sim_mem[i] & ~f.bit) | (f.val ? f.bit : 0);
+	case FM_DECAY:
+		if (!(sim_mem[i] & f.bit) == !f.val &&
+				sim_now - f.wtime > f.hold) {
+			sim_mem[i] ^= f.bit;
+		}
+		break;
+	case FM_FLIP:
+		v = sim_mem[i];
+		if ((sim_rnd() & f.rate) == 0) {
+			v ^= f.bit;
+		}
+		return v;
+	}
+	return sim_mem[i];
+}
+
+static void sim_st(volatile ulong *a, ulong v)
+{
+	ulong i = sim_word(a), old = sim_mem[i];
+
+	if (i == f.w) {
+		if (f.model == FM_TRANS && (old ^ v) & f.bit &&
+				!(v & f.bit) == !f.val) {
+			v ^= f.bit;
+		}
+		f.wtime = sim_now;
+	}
+	sim_mem[i] = v;
+	if (f.model == FM_COUPLE && i == f.aw && (old ^ v) & f.abit &&
+			!(v & f.abit) == !f.adir) {
+		sim_mem[f.w] = (sim_mem[f.w] & ~f.bit) | (f.val ? f.bit : 0);
+	}
+}
+
+static void sim_err(void)
+{
+	if (!sim_hit) {
+		sim_hit = sim_now;
+	}
+}
+
+/* The kernels with the fault model in the way */
+#define K_LD(a)		sim_ld(a)
+#define K_ERR(a, g, b)	sim_err()
+#define K_SIM(a, v)	sim_st((a), (v))
+#define K_SIM_END()
+#include "kernel.h"
+
+static K_INV(sim_inv_up, 1, K_SIM)
+static K_INV(sim_inv_down, -1, K_SIM)
+static K_SFILL(sim_fill, 1, K_SIM)
+static K_SCHK(sim_chk, 1)
+static K_SFILL(sim_mod_fill, MOD_SZ, K_SIM)
+static K_SCHK(sim_mod_chk, MOD_SZ)
+static K_SKIP(sim_mod_skip, MOD_SZ, K_SIM)
+static K_RFILL(sim_rand_fill, K_SIM)
+static K_RINV(sim_rand_inv, K_SIM)
+
+/* Put a fault of the given model in a random place */
+static void sim_place(int model)
+{
+	f.model = model;
+	f.w = sim_rnd() % SIM_WORDS;
+	f.bit = 1 << (sim_rnd() & 31);
+	f.val = sim_rnd() & 1;
+	f.aw = f.alias = ~0;
+	switch (model) {
+	case FM_COUPLE:
+		do {
+			f.aw = sim_rnd() % SIM_WORDS;
+		} while (f.aw == f.w);
+		f.abit = 1 << (sim_rnd() & 31);
+		f.adir = sim_rnd() & 1;
+		break;
+	case FM_ALIAS:
+		f.alias = f.w ^ (1 << (sim_rnd() % 14));
+		break;
+	case FM_DECAY:
+		/* 50 ms to 200 s, spread evenly in log scale */
+		f.hold = udiv64((unsigned long long)acc_per_sec *
+			(50 << (sim_rnd() % 13)), 1000);
+		f.wtime = 0;
+		break;
+	case FM_FLIP:
+		/* One read in 4 to one in 4096 */
+		f.rate = (1 << (2 + sim_rnd() % 11)) - 1;
+		break;
+	}
+}
+
+/* The address tests, see addr_tst1 and addr_tst2 in test.c */
+static void sim_addr1(void)
+{
+	ulong *p = sim_mem, *pt, p1, mask;
+	int i, j;
+
+	for (p1 = 0, j = 0; j < 2; j++) {
+		sim_st(p, p1);
+		p1 = ~p1;
+		for (i = 0; i < 100 && !sim_hit; i++) {
+			for (mask = 4; mask < SIM_WORDS * 4; mask <<= 1) {
+				pt = (ulong *)((ulong)p | mask);
+				sim_st(pt, p1);
+				if (sim_ld(p) != ~p1) {
+					sim_err();
+				}
+			}
+		}
+	}
+}
+
+static void sim_addr2(void)
+{
+	ulong *p;
+
+	for (p = sim_mem; p < sim_mem + SIM_WORDS; p++) {
+		sim_st(p, (ulong)p);
+	}
+	for (p = sim_mem; p < sim_mem + SIM_WORDS; p++) {
+		if (sim_ld(p) != (ulong)p) {
+			sim_err();
+		}
+	}
+}
+
+/* See movinv1 in test.c */
+static void sim_movinv1(int iter, ulong p1, ulong p2)
+{
+	ulong *pe = sim_mem + SIM_WORDS - 1;
+	int i;
+
+	sim_fill(sim_mem, pe + 1, p1);
+	for (i = 0; i < iter && !sim_hit; i++) {
+		sim_inv_up(sim_mem, pe, p1, p2);
+		sim_inv_down(pe, sim_mem, p2, p1);
+	}
+}
+
+/* See block_move in test.c, the pattern turns with rcl so it repeats
+ * every 33 blocks */
+static void sim_block_move(int iter)
+{
+	static const char inv[16] = { 0,0,0,0,1,1,0,0,0,0,1,1,0,0,1,1 };
+	ulong len = SIM_WORDS / 2, *pp = sim_mem + len, a, i;
+	int n;
+
+	for (i = 0; i < SIM_WORDS; i++) {
+		a = (i / 16) % 33 < 32 ? 1 << (i / 16) % 33 : 0;
+		sim_st(&sim_mem[i], inv[i % 16] ? ~a : a);
+	}
+	for (n = 0; n < iter && !sim_hit; n++) {
+		for (i = 0; i < len; i++) {
+			sim_st(&pp[i], sim_ld(&sim_mem[i]));
+		}
+		for (i = 0; i < len - 8; i++) {
+			sim_st(&sim_mem[8 + i], sim_ld(&pp[i]));
+		}
+		for (i = 0; i < 8; i++) {
+			sim_st(&sim_mem[i], sim_ld(&pp[len - 8 + i]));
+		}
+	}
+	for (i = 0; i < SIM_WORDS; i += 2) {
+		if (sim_ld(&sim_mem[i]) != sim_ld(&sim_mem[i + 1])) {
+			sim_err();
+		}
+	}
+}
+
+/* See movinv32 in test.c, word i holds t[(off + i) % 32] */
+static void sim_movinv32(int iter, ulong lb, ulong sval, int off)
+{
+	ulong t[32], g, i;
+	int k, n;
+
+	for (t[0] = lb, k = 1; k < 32; k++) {
+		t[k] = t[k - 1] << 1 | sval;
+	}
+	for (i = 0; i < SIM_WORDS; i++) {
+		sim_st(&sim_mem[i], t[(off + i) & 31]);
+	}
+	for (n = 0; n < iter && !sim_hit; n++) {
+		for (i = 0; i < SIM_WORDS; i++) {
+			g = t[(off + i) & 31];
+			if (sim_ld(&sim_mem[i]) != g) {
+				sim_err();
+			}
+			sim_st(&sim_mem[i], ~g);
+		}
+		for (i = SIM_WORDS; i-- > 0; ) {
+			g = t[(off + i) & 31];
+			if (sim_ld(&sim_mem[i]) != ~g) {
+				sim_err();
+			}
+			sim_st(&sim_mem[i], g);
+		}
+	}
+}
+
+/* See modtst in test.c */
+static void sim_modtst(int off, int iter, ulong p1, ulong p2)
+{
+	ulong *pe = sim_mem + SIM_WORDS - 1;
+	int i;
+
+	sim_mod_fill(sim_mem + off, pe + 1, p1);
+	for (i = 0; i < iter; i++) {
+		sim_mod_skip(sim_mem, pe, p2, 0, off);
+	}
+	sim_mod_chk(sim_mem + off, pe + 1, p1);
+}
+
+/* Run one test over the array like do_test() in main.c does */
+static void sim_test(int t)
+{
+	int iter = tseq[t].iter, i, j;
+	ulong p0, p1, p2;
+	ulong seed1, seed2;
+
+	switch (tseq[t].pat) {
+	case 0:
+		sim_addr1();
+		break;
+	case 1:
+	case 2:
+		sim_addr2();
+		break;
+	case 3:
+	case 4:
+		sim_movinv1(iter, 0, ~0);
+		sim_movinv1(iter, ~0, 0);
+		break;
+	case 5:
+		for (i = 0, p0 = 0x80; i < 8 && !sim_hit; i++, p0 >>= 1) {
+			p1 = p0 | (p0 << 8) | (p0 << 16) | (p0 << 24);
+			sim_movinv1(iter, p1, ~p1);
+			sim_movinv1(iter, ~p1, p1);
+		}
+		break;
+	case 6:
+		rand_seed(sim_rnd(), sim_rnd(), 0);
+		for (i = 0; i < iter && !sim_hit; i++) {
+			p1 = rand(0);
+			sim_movinv1(2, p1, ~p1);
+		}
+		break;
+	case 7:
+		sim_block_move(iter);
+		break;
+	case 8:
+		for (i = 0, p1 = 1; p1 && !sim_hit; p1 <<= 1, i++) {
+			sim_movinv32(iter, 1, 0, i);
+			sim_movinv32(iter, 0xfffffffe, 1, i);
+		}
+		break;
+	case 9:
+		for (j = 0; j < iter && !sim_hit; j++) {
+			seed1 = sim_rnd();
+			seed2 = sim_rnd();
+			rand_seed(seed1, seed2, 0);
+			sim_rand_fill(sim_mem, sim_mem + SIM_WORDS - 1, 0);
+			for (i = 0; i < 2; i++) {
+				rand_seed(seed1, seed2, 0);
+				sim_rand_inv(sim_mem, sim_mem + SIM_WORDS - 1,
+					i ? ~0 : 0, 0);
+			}
+		}
+		break;
+	case 10:
+		for (j = 0; j < iter && !sim_hit; j++) {
+			p1 = sim_rnd();
+			for (i = 0; i < MOD_SZ && !sim_hit; i++) {
+				p2 = ~p1;
+				sim_modtst(i, 2, p1, p2);
+				sim_modtst(i, 2, p2, p1);
+			}
+		}
+		break;
+	case 11:
+		for (p1 = 0, i = 0; i < 2 && !sim_hit; i++, p1 = ~p1) {
+			sim_fill(sim_mem, sim_mem + SIM_WORDS, p1);
+			sim_now += (unsigned long long)iter * acc_per_sec;
+			sim_chk(sim_mem, sim_mem + SIM_WORDS, p1);
+		}
+		break;
+	case 12:
+	case 14:
+		/* Read disturb and the paths between the CPUs are not among
+		 * the models, this is only the fill and the check */
+		for (p1 = 0, i = 0; i < 2 && !sim_hit; i++, p1 = ~p1) {
+			sim_fill(sim_mem, sim_mem + SIM_WORDS, p1);
+			sim_chk(sim_mem, sim_mem + SIM_WORDS, p1);
+		}
+		break;
+	}
+}
+
+static ulong number(char *cp)
+{
+	ulong n = 0;
+
+	while (isdigit(*cp)) {
+		n = n * 10 + *cp++ - '0';
+	}
+	return n;
+}
+
+/* Parse the options for the simulator, returns 0 if it is not one */
+int sim_option(char *cp)
+{
+	if (!strncmp(cp, "sim=", 4)) {
+		trials = number(cp + 4);
+	} else if (!strncmp(cp, "simbw=", 6)) {
+		sim_bw = number(cp + 6);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Run the trials for each selected test and fault model and report the
+ * percentage found and the mean time to find it.  Returns -1 if the
+ * simulator was not asked for.
+ */
+int sim_run(void)
+{
+	unsigned long long sum;
+	ulong found, i;
+	int t, m, n, x, y;
+
+	if (trials <= 0) {
+		return -1;
+	}
+	if (sim_bw <= 0) {
+		sim_bw = 4000;
+	}
+	acc_per_sec = (ulong)udiv64((unsigned long long)sim_bw * 1000000 / 4,
+		SIM_SCALE);
+
+	y = report_line();
+	cprint(y, 0, "Fault simulation:       trials, found % and mean ms to");
+	dprint(y, 18, trials, 5, 0);
+	y = report_line();
+	cprint(y, 0, "find in 1 GB at       MB/s");
+	dprint(y, 16, sim_bw, 5, 0);
+	y = report_line();
+	cprint(y, 0, "Tst");
+	for (m = 0; m < FM_MAX; m++) {
+		cprint(y, 4 + m * 12 + 11 - strlen(fm_names[m]), fm_names[m]);
+	}
+	for (t = 0; tseq[t].cpu_sel; t++) {
+		if (!tseq[t].sel) {
+			continue;
+		}
+		y = report_line();
+		dprint(y, 0, t, 3, 0);
+		for (m = 0; m < FM_MAX; m++) {
+			found = 0;
+			sum = 0;
+			for (n = 0; n < trials; n++) {
+				/* The same faults for every test */
+				rnd_state = 0x9e3779b9 * (n * FM_MAX + m + 1);
+				for (i = 0; i < SIM_WORDS; i++) {
+					sim_mem[i] = sim_rnd();
+				}
+				sim_now = 0;
+				sim_hit = 0;
+				sim_place(m);
+				sim_test(t);
+				if (sim_hit) {
+					found++;
+					sum += sim_hit;
+				}
+			}
+			x = 4 + m * 12;
+			dprint(y, x, found * 100 / trials, 3, 0);
+			cprint(y, x + 3, "%");
+			if (found) {
+				dprint(y, x + 4, (ulong)udiv64(udiv64(sum, found) *
+					1000, acc_per_sec), 7, 0);
+			} else {
+				cprint(y, x + 4, "      -");
+			}
+		}
+		os_flush();
+	}
+	os_flush();
+	return 0;
+}
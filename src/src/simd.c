@@ -0,0 +1,178 @@
+/* simd.c - MemTest-86  Version 4.1
+ *
+ * Pick the variant of each test kernel for the CPU.  The CPU features are
+ * ranked in levels and each kernel uses its best variant at or below the
+ * level of the CPU.  The "simd" option sets a lower level so the variants
+ * can be compared.  kvar[] only holds levels, not function pointers, so
+ * it stays valid when the program is relocated.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+
+extern struct cpu_ident cpu_id;
+extern short simd_max;
+
+#define L(l)	(1 << (l))
+
+int simd_level;
+char kvar[KV_MAX];
+
+static char *simd_names[SL_MAX] = {
+	"i386", "sse2", "sse4.1", "avx", "avx2", "avx512"
+};
+
+/* The levels that each kernel has a variant for */
+static struct {
+	char *name;
+	int lvls;
+} ktab[KV_MAX] = {
+	{ "fill",  L(SL_I386) | L(SL_SSE2) | L(SL_AVX) | L(SL_AVX512) },
+	{ "check", L(SL_I386) | L(SL_SSE2) | L(SL_AVX2) },
+	{ "tile",  L(SL_I386) | L(SL_SSE2) },
+	{ "copy",  L(SL_I386) | L(SL_SSE2) | L(SL_AVX) },
+	{ "flush", L(SL_I386) | L(SL_SSE2) },
+};
+
+char *simd_name(int l)
+{
+	return simd_names[l];
+}
+
+/* The highest level the CPU and the XSAVE state support */
+static int simd_cpu(void)
+{
+	ulong c1 = cpu_id.fid.uint32_array[1];
+
+	if (!cpu_id.fid.bits.sse2) {
+		return SL_I386;
+	}
+	if (!(c1 & CPUID1_SSE41)) {
+		return SL_SSE2;
+	}
+	if ((c1 & (CPUID1_XSAVE|CPUID1_AVX)) != (CPUID1_XSAVE|CPUID1_AVX) ||
+			(cpu_id.xcr0_ok & XCR0_AVX) != XCR0_AVX) {
+		return SL_SSE41;
+	}
+	if (!(cpu_id.fid7 & CPUID7_AVX2)) {
+		return SL_AVX;
+	}
+	if (!(cpu_id.fid7 & CPUID7_AVX512F) ||
+			(cpu_id.xcr0_ok & XCR0_AVX512) != XCR0_AVX512) {
+		return SL_AVX2;
+	}
+	return SL_AVX512;
+}
+
+/*
+ * Turn on the XSAVE state for the AVX and AVX-512 registers.  Every CPU
+ * has to do this, it is done for all of the state the CPU supports so it
+ * does not depend on the level picked by the boot CPU.
+ */
+void simd_setup(void)
+{
+	ulong lo, hi, on;
+
+	if (!(cpu_id.fid.uint32_array[1] & CPUID1_XSAVE)) {
+		return;
+	}
+	on = cpu_id.xcr0_ok & XCR0_AVX;
+	if ((cpu_id.xcr0_ok & XCR0_AVX512) == XCR0_AVX512) {
+		on |= XCR0_AVX512;
+	}
+	asm __volatile__ (
+		"movl %%cr4,%%eax\n\t"
+		"orl $0x00040000,%%eax\n\t"
+		"movl %%eax,%%cr4\n\t"
+		: : : "ax"
+	);
+	asm __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	asm __volatile__ ("xsetbv" : : "a" (lo | on), "d" (hi), "c" (0));
+}
+
+/* List the features that the kernels can use */
+static void simd_show_cpu(void)
+{
+	static struct {
+		char *name;
+		uint32_t *reg;
+		uint32_t bit;
+	} f[] = {
+		{ "sse4.1", &cpu_id.fid.uint32_array[1], CPUID1_SSE41 },
+		{ "avx", &cpu_id.fid.uint32_array[1], CPUID1_AVX },
+		{ "avx2", &cpu_id.fid7, CPUID7_AVX2 },
+		{ "avx512f", &cpu_id.fid7, CPUID7_AVX512F },
+		{ "erms", &cpu_id.fid7, CPUID7_ERMS },
+		{ "clflushopt", &cpu_id.fid7, CPUID7_CLFLUSHOPT },
+		{ "clwb", &cpu_id.fid7, CPUID7_CLWB },
+		{ "movdir64b", &cpu_id.fid7c, CPUID7C_MOVDIR64B },
+	};
+	int i, x, y;
+
+	if ((y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "CPU features:");
+	x = 14;
+	if (cpu_id.fid.bits.sse2) {
+		cprint(y, x, "sse2");
+		x += 5;
+	}
+	for (i = 0; i < sizeof(f) / sizeof(f[0]); i++) {
+		if (*f[i].reg & f[i].bit) {
+			cprint(y, x, f[i].name);
+			x += strlen(f[i].name) + 1;
+		}
+	}
+}
+
+/*
+ * Work out the level and the variant of each kernel, then show them.
+ * Called by the boot CPU at startup.
+ */
+void simd_select(void)
+{
+	int k, l, x, y;
+
+	simd_level = simd_cpu();
+	if (simd_max && simd_max - 1 < simd_level) {
+		simd_level = simd_max - 1;
+	}
+	for (k = 0; k < KV_MAX; k++) {
+		for (l = simd_level; !(ktab[k].lvls & L(l)); l--)
+			;
+		kvar[k] = l;
+	}
+
+	/* The flush needs clflush as well as mfence */
+	if (!cpu_id.fid.bits.cflush) {
+		kvar[KV_FLUSH] = SL_I386;
+	}
+	btrace(0, __LINE__, "SIMD      ", 1, simd_level, simd_cpu());
+
+	simd_show_cpu();
+	if ((y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "Kernels:");
+	cprint(y, 9, simd_name(simd_level));
+	x = 10 + strlen(simd_name(simd_level));
+	if (simd_level < simd_cpu()) {
+		cprint(y, x, "(set)");
+		x += 6;
+	}
+	for (k = 0; k < KV_MAX; k++) {
+		cprint(y, x, ktab[k].name);
+		x += strlen(ktab[k].name) + 1;
+		if (k == KV_FLUSH) {
+			cprint(y, x, kvar[k] == SL_I386 ? "off" :
+				(cpu_id.fid7 & CPUID7_CLFLUSHOPT) ?
+				"clflushopt" : "clflush");
+			break;
+		}
+		cprint(y, x, simd_name(kvar[k]));
+		x += strlen(simd_name(kvar[k])) + 1;
+	}
+}
@@ -0,0 +1,375 @@
+/* stats.c - MemTest-86  Version 4.1
+ *
+ * Throughput accounting for the tests.  The kernels in test.c count the
+ * bytes they read and write in cpu_acct[], these are collected after
+ * each window into per test and per CPU totals for the pass.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "smp.h"
+
+extern struct barrier_s *barr;
+extern struct tseq tseq[];
+extern volatile int test;
+extern int act_cpus;
+extern short onepass;
+extern volatile short btflag;
+extern int smp_ord_to_cpu(int me);
+extern int budget_min;
+extern ulong spd[];
+extern unsigned long long find_bytes_for_test(int tst, int c);
+extern ulong find_sleep_for_test(int tst, int c);
+extern int find_iter(int tst, int pass);
+extern int find_next_test(int tst);
+
+/* Don't trust the rate of a test until it has run this long (msec) */
+#define ETA_MIN_MS	500
+
+struct cpu_acct cpu_acct[MAX_CPUS] __attribute__((aligned(64)));
+
+struct tstat {
+	uint64_t rd;		/* Bytes read */
+	uint64_t wr;		/* Bytes written */
+	uint64_t clks;		/* Elapsed clocks */
+	uint64_t idle;		/* Clocks spent sleeping */
+};
+
+static struct tstat tst_stat[MAX_TESTS];	/* Wall clock time per test */
+static struct tstat cpu_stat[MAX_CPUS];		/* Busy time per CPU */
+static uint64_t cpu_tsc[MAX_CPUS];
+static uint64_t tst_mark, pass_mark, idle_mark;
+
+/* Measured throughput of each test in bytes/msec and the ratio of the
+ * measured bytes to the estimate from find_bytes_for_test() in 1/1024 */
+static ulong tst_rate[MAX_TESTS];
+static ulong tst_corr[MAX_TESTS];
+static ulong eta_rate;
+static int tst_iter[MAX_TESTS];		/* Iterations the test ran with */
+
+uint64_t get_tsc(void)
+{
+	ulong l, h;
+
+	if (!cpu_id.fid.bits.rdtsc) {
+		return 0;
+	}
+	asm __volatile__ ("rdtsc":"=a" (l),"=d" (h));
+	return ((uint64_t)h << 32) | l;
+}
+
+/*
+ * Start timing this CPU for a window
+ */
+void stat_start(int me)
+{
+	cpu_tsc[me] = get_tsc();
+}
+
+/*
+ * Collect the counts from this CPU for a window
+ */
+void stat_stop(int me)
+{
+	uint64_t clks = get_tsc() - cpu_tsc[me];
+
+	spin_lock(&barr->mutex);
+	if (test < MAX_TESTS) {
+		tst_stat[test].rd += cpu_acct[me].rd;
+		tst_stat[test].wr += cpu_acct[me].wr;
+	}
+	cpu_stat[me].rd += cpu_acct[me].rd;
+	cpu_stat[me].wr += cpu_acct[me].wr;
+	cpu_stat[me].clks += clks;
+	cpu_acct[me].rd = 0;
+	cpu_acct[me].wr = 0;
+	spin_unlock(&barr->mutex);
+}
+
+/*
+ * Mark the start (flag = 1) and end (flag = 0) of a sleep so that the
+ * sleep is not counted as testing time
+ */
+void stat_idle(int flag)
+{
+	uint64_t t = get_tsc();
+
+	if (flag) {
+		idle_mark = t;
+	} else if (idle_mark) {
+		if (test < MAX_TESTS) {
+			tst_stat[test].idle += t - idle_mark;
+		}
+		idle_mark = 0;
+	}
+}
+
+/*
+ * Charge the time since the last mark to the current test, which ran
+ * with iter iterations.  Called by the master CPU at the end of each test.
+ */
+void stat_mark(int iter)
+{
+	uint64_t t = get_tsc();
+	struct tstat *s;
+	ulong ms;
+
+	stat_idle(0);
+	if (pass_mark == 0) {
+		pass_mark = t;
+	}
+	if (tst_mark && test < MAX_TESTS) {
+		s = &tst_stat[test];
+		s->clks += t - tst_mark;
+		tst_iter[test] = iter;
+
+		/* Remember the rate for estimating the next pass */
+		ms = udiv64(s->clks - s->idle, v->clks_msec);
+		if (ms >= ETA_MIN_MS) {
+			tst_rate[test] = eta_rate = udiv64(s->rd + s->wr, ms);
+		}
+	}
+	tst_mark = t;
+}
+
+/* Convert clocks to milliseconds */
+static ulong clks_to_ms(uint64_t clks)
+{
+	return udiv64(clks, v->clks_msec);
+}
+
+/* Print a time in seconds as hhhh:mm:ss */
+static void tprint(int y, int x, ulong t)
+{
+	dprint(y, x, t/3600, 4, 0);
+	cprint(y, x+4, ":");
+	dprint(y, x+5, (t/600) % 6, 1, 0);
+	dprint(y, x+6, (t/60) % 10, 1, 0);
+	cprint(y, x+7, ":");
+	dprint(y, x+8, (t/10) % 6, 1, 0);
+	dprint(y, x+9, t % 10, 1, 0);
+}
+
+/* Print a value in hundredths as nnnnnn.nn */
+static void fprint(int y, int x, ulong n)
+{
+	dprint(y, x, n/100, 6, 0);
+	cprint(y, x+6, ".");
+	dprint(y, x+7, (n/10) % 10, 1, 0);
+	dprint(y, x+8, n % 10, 1, 0);
+}
+
+/* Compute a * 1024 / b with both values scaled to fit */
+static ulong ratio1024(uint64_t a, uint64_t b)
+{
+	while (b >> 32 || a >> 53) {
+		a >>= 1;
+		b >>= 1;
+	}
+	if (b == 0) {
+		return 0;
+	}
+	return udiv64(a << 10, b);
+}
+
+/* Estimated bytes for a test, corrected by what we measured last time */
+static uint64_t est_bytes(int t, int c)
+{
+	uint64_t n = find_bytes_for_test(t, c);
+
+	if (tst_corr[t]) {
+		n = (n >> 10) * tst_corr[t];
+	}
+	return n;
+}
+
+/*
+ * Estimate the msec a test takes with c iterations.  Until something
+ * has been measured we guess from the memory speed.
+ */
+ulong stat_est_ms(int t, int c)
+{
+	ulong rate;
+
+	rate = tst_rate[t] ? tst_rate[t] : eta_rate;
+	if (rate == 0) {
+		rate = spd[0] << 8;
+	}
+	if (rate == 0) {
+		rate = 1;
+	}
+	return udiv64(est_bytes(t, c), rate) + find_sleep_for_test(t, c) * 1000;
+}
+
+/* Msec the current test has been running */
+ulong stat_test_ms(void)
+{
+	if (!cpu_id.fid.bits.rdtsc || tst_mark == 0 || test >= MAX_TESTS) {
+		return 0;
+	}
+	return clks_to_ms(get_tsc() - tst_mark + tst_stat[test].clks);
+}
+
+/*
+ * Estimate the time left in the test, the pass and the run from the
+ * measured throughput and display it.  Also computes the percent done
+ * for the test and the pass.  Returns 0 if there is no estimate yet.
+ */
+int stat_eta(int *tpct, int *ppct)
+{
+	struct tstat *s;
+	uint64_t now, done, idle, est;
+	ulong el, busy, rate, rem, prem, sl, n;
+	int i, c;
+
+	if (!cpu_id.fid.bits.rdtsc || test >= MAX_TESTS || tst_mark == 0) {
+		return 0;
+	}
+	now = get_tsc();
+	s = &tst_stat[test];
+
+	/* Bytes done so far, including the CPUs that are still running */
+	done = s->rd + s->wr;
+	for (i = 0; i < act_cpus; i++) {
+		done += cpu_acct[i].rd + cpu_acct[i].wr;
+	}
+	idle = s->idle;
+	if (idle_mark) {
+		idle += now - idle_mark;
+	}
+	el = clks_to_ms(now - tst_mark + s->clks);
+	busy = clks_to_ms(now - tst_mark + s->clks - idle);
+
+	/* Use the rate of this test once it has run for a few chunks,
+	 * until then use what we measured last time */
+	if (busy >= ETA_MIN_MS && done) {
+		rate = udiv64(done, busy);
+	} else if (tst_rate[test]) {
+		rate = tst_rate[test];
+	} else {
+		rate = eta_rate;
+	}
+	if (rate == 0) {
+		return 0;
+	}
+
+	/* Time left in this test */
+	rem = 0;
+	c = find_iter(test, v->pass);
+	est = est_bytes(test, c);
+	if (est > done) {
+		rem = udiv64(est - done, rate);
+	}
+	sl = find_sleep_for_test(test, c) * 1000;
+	if (sl > clks_to_ms(idle)) {
+		rem += sl - clks_to_ms(idle);
+	}
+
+	/* Add the remaining tests in the pass */
+	prem = rem;
+	for (i = find_next_test(test); i >= 0 && i < MAX_TESTS;
+			i = find_next_test(i)) {
+		c = find_iter(i, v->pass);
+		n = tst_rate[i] ? tst_rate[i] : rate;
+		prem += udiv64(est_bytes(i, c), n);
+		prem += find_sleep_for_test(i, c) * 1000;
+	}
+
+	*tpct = el + rem ? udiv64((uint64_t)el * 100, el + rem) : 0;
+	el = clks_to_ms(now - pass_mark);
+	*ppct = el + prem ? udiv64((uint64_t)el * 100, el + prem) : 0;
+
+	if (btflag) {
+		return 1;
+	}
+	cprint(LINE_ETA, 0, "Time Left   Test:");
+	tprint(LINE_ETA, 17, rem/1000);
+	cprint(LINE_ETA, 30, "Pass:");
+	tprint(LINE_ETA, 35, prem/1000);
+	cprint(LINE_ETA, 48, "Run:");
+	if (budget_min) {
+		tprint(LINE_ETA, 52, budget_left()/1000);
+	} else if (onepass) {
+		tprint(LINE_ETA, 52, prem/1000);
+	} else {
+		cprint(LINE_ETA, 52, "         -");
+	}
+	return 1;
+}
+
+/* GB/s in hundredths */
+static ulong gbps(uint64_t bytes, ulong ms)
+{
+	if (ms == 0) {
+		return 0;
+	}
+	return udiv64(udiv64(bytes, ms), 10000);
+}
+
+/*
+ * Display the elapsed time and throughput for each test and each CPU
+ * for the pass and then clear the totals for the next pass
+ */
+void stat_report(void)
+{
+	int i, y, x;
+	ulong ms, total;
+	struct tstat *s;
+
+	if (!cpu_id.fid.bits.rdtsc) {
+		return;
+	}
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "Tst        Time Read(GB)  Write(GB)      GB/s");
+	}
+	for (i = 0, total = 0; tseq[i].msg != NULL && i < MAX_TESTS; i++) {
+		s = &tst_stat[i];
+		if (s->clks == 0 || s->rd + s->wr == 0) {
+			continue;
+		}
+		ms = clks_to_ms(s->clks);
+		total += ms;
+
+		/* Correct the estimate for the next pass */
+		if (v->pass > 0) {
+			tst_corr[i] = ratio1024(s->rd + s->wr,
+				find_bytes_for_test(i, tst_iter[i]));
+		}
+		if ((y = report_line()) < 0) {
+			continue;
+		}
+		dprint(y, 0, i, 3, 0);
+		tprint(y, 5, ms/1000);
+		fprint(y, 15, udiv64(s->rd, 10000000));
+		fprint(y, 26, udiv64(s->wr, 10000000));
+		fprint(y, 36, gbps(s->rd + s->wr, ms));
+	}
+	if ((y = report_line()) >= 0) {
+		cprint(y, 0, "Pass");
+		tprint(y, 5, total/1000);
+	}
+	for (i = 0, x = 80; i < act_cpus; i++) {
+		s = &cpu_stat[i];
+		if (x > 80-26) {
+			if ((y = report_line()) < 0) {
+				break;
+			}
+			x = 0;
+		}
+		cprint(y, x, "CPU");
+		dprint(y, x+3, smp_ord_to_cpu(i), 3, 0);
+		fprint(y, x+7, gbps(s->rd + s->wr, clks_to_ms(s->clks)));
+		cprint(y, x+17, "GB/s");
+		x += 26;
+	}
+	for (i = 0; i < MAX_TESTS; i++) {
+		tst_stat[i].rd = tst_stat[i].wr = 0;
+		tst_stat[i].clks = tst_stat[i].idle = 0;
+	}
+	for (i = 0; i < MAX_CPUS; i++) {
+		cpu_stat[i].rd = cpu_stat[i].wr = cpu_stat[i].clks = 0;
+	}
+	pass_mark = get_tsc();
+}
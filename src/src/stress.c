@@ -0,0 +1,234 @@
+/* stress.c - MemTest-86  Version 4.1
+ *
+ * Stress test.  The other tests wait at barriers and go through memory
+ * in order, so the memory rarely runs hot for long.  Here every CPU
+ * copies large blocks of its part of memory to a free block, picked at
+ * random, for a set time.  Each block holds a sequence made from its
+ * seed and has a checksum that is checked after every copy.  A copy that
+ * fails is compared with the sequence to find the words that are wrong.
+ * The checksum is CRC32C when the CPU has SSE4.2.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "stdint.h"
+#include "test.h"
+#include "cpuid.h"
+#include "smp.h"
+
+extern struct cpu_ident cpu_id;
+extern volatile int segs, bail;
+extern short copy_sel;
+extern int stress_min;
+extern ulong rand(int cpu);
+extern void rand_seed(unsigned int seed1, unsigned int seed2, int cpu);
+extern void calculate_chunk(ulong **start, ulong **end, int me, int j,
+	int makeMultipleOf);
+
+#define STRESS_NBLK	64		/* Blocks in each CPU's part */
+#define STRESS_MINBLK	0x4000		/* Smallest block in words */
+#define STRESS_TICK	1000		/* Msec between ticks */
+
+static struct {
+	ulong seed[STRESS_NBLK];	/* Sequence in each block */
+	ulong sum[STRESS_NBLK];		/* and its checksum */
+	uint64_t bytes;			/* Copied and checked */
+	uint64_t clks;
+	ulong copies;
+	ulong bad;			/* Copies that failed the checksum */
+} st[MAX_CPUS];
+
+/* Seconds that the test runs for in each pass */
+ulong stress_time(void)
+{
+	return stress_min ? stress_min * 60 : STRESS_SEC;
+}
+
+static int crc_ok(void)
+{
+	return (cpu_id.fid.uint32_array[1] & CPUID1_SSE42) &&
+		simd_level >= SL_SSE41;
+}
+
+/* Checksum of the len words at p */
+static ulong stress_sum(ulong *p, ulong len, int crc)
+{
+	ulong s = ~0;
+
+	if (crc) {
+		asm __volatile__ (
+			"1:\n\t"
+			"crc32l (%1),%0\n\t"
+			"addl $4,%1\n\t"
+			"decl %2\n\t"
+			"jnz 1b\n\t"
+			: "+r" (s), "+r" (p), "+r" (len)
+			:
+			: "memory", "cc"
+		);
+		return ~s;
+	}
+	asm __volatile__ (
+		"1:\n\t"
+		"roll $1,%0\n\t"
+		"addl (%1),%0\n\t"
+		"addl $4,%1\n\t"
+		"decl %2\n\t"
+		"jnz 1b\n\t"
+		: "+r" (s), "+r" (p), "+r" (len)
+		:
+		: "memory", "cc"
+	);
+	return s;
+}
+
+static ulong stress_next(ulong x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static void stress_fill(ulong *p, ulong len, ulong seed)
+{
+	for (; len; len--, p++) {
+		seed = stress_next(seed);
+		*p = seed;
+	}
+}
+
+/*
+ * Report the words that are wrong in block a and in its copy b, both
+ * should hold the sequence from seed.  A word that is wrong the same way
+ * in both went bad in a before the copy.  Both are put right.
+ */
+static void stress_fix(ulong *a, ulong *b, ulong len, ulong seed)
+{
+	ulong ga, gb;
+
+	for (; len; len--, a++, b++) {
+		seed = stress_next(seed);
+		ga = *a;
+		gb = *b;
+		if (ga != seed) {
+			error(a, seed, ga);
+			*a = seed;
+		}
+		if (gb != seed && gb != ga) {
+			error(b, seed, gb);
+		}
+		*b = seed;
+	}
+}
+
+void stress(int me)
+{
+	ulong *start, *end, *a, *b, len, blk, ms, t, r, rounds;
+	uint64_t t0;
+	int i, j, nblk, free, e, wide, crc = crc_ok();
+
+	wide = copy_ok(CE_AVX) ? CE_AVX : copy_ok(CE_SSE) ? CE_SSE : CE_MOVSD;
+	rand_seed(get_tsc() + me, 521288629 + v->pass, me);
+
+	for (j = 0; j < segs; j++) {
+		calculate_chunk(&start, &end, me, j, 64);
+		len = end - start + 1;
+
+		/* The segment gets its share of the time */
+		ms = udiv64((uint64_t)stress_time() * 1000 *
+			((v->map[j].end - v->map[j].start + 1) >> 10),
+			v->selected_pages);
+		do_tick(me);
+		BAILR
+
+		/* Fill all but the last block, it is the first one free */
+		blk = len / STRESS_NBLK;
+		if (blk < STRESS_MINBLK) {
+			blk = STRESS_MINBLK;
+		}
+		blk &= ~15;
+		nblk = len / blk;
+		for (i = 0; i < nblk - 1; i++) {
+			st[me].seed[i] = rand(me) | 1;
+			stress_fill(start + i * blk, blk, st[me].seed[i]);
+			st[me].sum[i] = stress_sum(start + i * blk, blk, crc);
+			ACCT_WR(me, blk * 4);
+			ACCT_RD(me, blk * 4);
+		}
+		free = nblk - 1;
+
+		/* Every CPU ticks once a second so they all tick as often */
+		t0 = get_tsc();
+		rounds = ms / STRESS_TICK + 1;
+		for (r = 1; r <= rounds; r++) {
+			do {
+				if (nblk >= 2) {
+					i = (free + 1 + rand(me) % (nblk - 1)) %
+						nblk;
+					a = start + i * blk;
+					b = start + free * blk;
+					if (copy_sel) {
+						e = copy_engine();
+					} else if ((st[me].copies & 1) &&
+							copy_ok(CE_NT)) {
+						e = CE_NT;
+					} else {
+						e = wide;
+					}
+					copy_words(b, a, blk, e);
+					if (stress_sum(b, blk, crc) !=
+							st[me].sum[i]) {
+						st[me].bad++;
+						stress_fix(a, b, blk,
+							st[me].seed[i]);
+					}
+					st[me].seed[free] = st[me].seed[i];
+					st[me].sum[free] = st[me].sum[i];
+					free = i;
+					st[me].copies++;
+					st[me].bytes += blk * 12;
+					ACCT_RD(me, blk * 8);
+					ACCT_WR(me, blk * 4);
+				}
+				t = udiv64(get_tsc() - t0, v->clks_msec);
+			} while (t < r * STRESS_TICK && t < ms);
+			do_tick(me);
+			BAILR
+		}
+		st[me].clks += get_tsc() - t0;
+	}
+}
+
+/*
+ * Show the sustained speed of the copies and checks, with all CPUs
+ * together.  Called by the master CPU after the test.
+ */
+void stress_report(void)
+{
+	uint64_t bytes = 0, clks = 0;
+	ulong copies = 0, bad = 0, gb;
+	int i, y;
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		bytes += st[i].bytes;
+		if (st[i].clks > clks) {
+			clks = st[i].clks;
+		}
+		copies += st[i].copies;
+		bad += st[i].bad;
+		st[i].bytes = st[i].clks = 0;
+		st[i].copies = st[i].bad = 0;
+	}
+	if (clks == 0 || (y = report_line()) < 0) {
+		return;
+	}
+	/* Bytes per msec / 10^4 is GB/s * 100 */
+	gb = udiv64(udiv64(bytes * v->clks_msec, clks), 10000);
+	cprint(y, 0, "Stress:     .   GB/s,           copies,       bad,");
+	dprint(y, 8, gb / 100, 4, 0);
+	dprint(y, 13, gb / 10 % 10, 1, 0);
+	dprint(y, 14, gb % 10, 1, 0);
+	dprint(y, 22, copies, 9, 0);
+	dprint(y, 40, bad, 5, 0);
+	cprint(y, 51, crc_ok() ? "crc32c" : "sum");
+}
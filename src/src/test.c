@@ -4,6 +4,7 @@
  * By Chris Brady
  */
 #include "test.h"
+#include "kernel.h"
 #include "config.h"
 #include "stdint.h"
 #include "cpuid.h"
@@ -13,11 +14,17 @@ extern struct cpu_ident cpu_id;
 extern volatile int    mstr_cpu;
 extern volatile int    run_cpus;
 extern volatile int    test;
+extern volatile short  cpu_mode;
+extern volatile short  cpu_sel;
+extern short pipeline;
+extern short copy_sel;
+extern int copy_best;
 extern volatile int segs, bail;
 extern int test_ticks, nticks;
 extern struct tseq tseq[];
 extern void update_err_counts(void);
 extern void print_err_counts(void);
+extern int smp_ord_to_cpu(int me);
 void rand_seed( unsigned int seed1, unsigned int seed2, int me);
 ulong rand(int me);
 void poll_errors();
@@ -29,6 +36,16 @@ static inline ulong roundup(ulong value, ulong mask)
 	return (value + mask) & ~mask;
 }
 
+/* The chunk this CPU tests, in rotated mode it moves on to the next
+ * chunk for each sub-pass */
+static int chunk_index(int me)
+{
+	if (cpu_mode == CPM_ROTATE) {
+		return (me + cpu_sel) % run_cpus;
+	}
+	return me;
+}
+
 // start / end - return values for range to test
 // me - this threads CPU number
 // j - index into v->map for current segment we are testing
@@ -36,6 +53,7 @@ static inline ulong roundup(ulong value, ulong mask)
 void calculate_chunk(ulong** start, ulong** end, int me, int j, int makeMultipleOf)
 {
 	ulong chunk;
+	int k;
 
 
 	// If we are only running 1 CPU then test the whole block
@@ -58,12 +76,13 @@ void calculate_chunk(ulong** start, ulong** end, int me, int j, int makeMultiple
 		// chunk = (chunk + (makeMultipleOf-1)) &  ~(makeMultipleOf-1);
 
 		// Figure out chunk boundaries
-		*start = (ulong*)((ulong)v->map[j].start+(chunk*me));
-		/* Set end addrs for the highest CPU num to the
+		k = chunk_index(me);
+		*start = (ulong*)((ulong)v->map[j].start+(chunk*k));
+		/* Set end addrs for the last chunk to the
 			* end of the segment for rounding errors */
 		// Also rounds down to boundary if needed, may miss some ram but better than crashing or producing false errors.
 		// This rounding probably will never happen as the segments should be in 4096 bytes pages if I understand correctly.
-		if (me == mstr_cpu) {
+		if (k == run_cpus-1) {
 			*end = (ulong*)(v->map[j].end);
 		} else {
 			*end = (ulong*)((ulong)(*start) + chunk);
@@ -72,22 +91,283 @@ void calculate_chunk(ulong** start, ulong** end, int me, int j, int makeMultiple
 	}
 }
 
+/*
+ * The address test can leave the caches on when it can flush the lines
+ * it uses, otherwise it has to run with the caches disabled.
+ */
+int addr_flush_ok(void)
+{
+	return kvar[KV_FLUSH] >= SL_SSE2;
+}
+
+/* Write back the line with a and drop the line with b so that the next
+ * read of b comes from memory */
+static inline void addr_flush(volatile ulong *a, volatile ulong *b)
+{
+	if (cpu_id.fid7 & CPUID7_CLFLUSHOPT) {
+		asm __volatile__ (
+			"clflushopt (%0)\n\t"
+			"clflushopt (%1)\n\t"
+			"mfence\n\t"
+			: : "r" (a), "r" (b) : "memory"
+		);
+	} else {
+		asm __volatile__ (
+			"clflush (%0)\n\t"
+			"clflush (%1)\n\t"
+			"mfence\n\t"
+			: : "r" (a), "r" (b) : "memory"
+		);
+	}
+}
+
+/*
+ * The fills only write memory, with SSE2 they use non-temporal stores so
+ * the lines are not read into the cache before they are written.  Each
+ * fill ends with an sfence so the stores are done before memory is read.
+ * With AVX and AVX-512 a whole 32 or 64 bytes goes in each store.
+ */
+int fill_nt_ok(void)
+{
+	return kvar[KV_FILL] >= SL_SSE2;
+}
+
+/* Fill len words at p, with non-temporal stores if nt is set */
+void fill_words(ulong *p, ulong len, ulong p1, int nt)
+{
+	ulong n, a;
+
+	/* Bytes per loop, which is also the alignment */
+	a = kvar[KV_FILL] == SL_AVX512 ? 64 : kvar[KV_FILL] == SL_AVX ? 32 : 16;
+	if (nt && len >= a) {
+		/* Store up to the boundary, then a bytes at a time */
+		for (; (ulong)p & (a - 1); len--) {
+			*p++ = p1;
+		}
+		n = len / (a / 4);
+		len &= a / 4 - 1;
+		switch(kvar[KV_FILL]) {
+		case SL_AVX512:
+			asm __volatile__ (
+				"vpbroadcastd %2,%%zmm0\n\t"
+				"1:\n\t"
+				"vmovntdq %%zmm0,(%0)\n\t"
+				"addl $64,%0\n\t"
+				"decl %1\n\t"
+				"jnz 1b\n\t"
+				"sfence\n\t"
+				"vzeroupper\n\t"
+				: "+r" (p), "+r" (n)
+				: "r" (p1)
+				: "memory", "cc"
+			);
+			break;
+		case SL_AVX:
+			asm __volatile__ (
+				"vbroadcastss %2,%%ymm0\n\t"
+				"1:\n\t"
+				"vmovntdq %%ymm0,(%0)\n\t"
+				"addl $32,%0\n\t"
+				"decl %1\n\t"
+				"jnz 1b\n\t"
+				"sfence\n\t"
+				"vzeroupper\n\t"
+				: "+r" (p), "+r" (n)
+				: "m" (p1)
+				: "memory", "cc"
+			);
+			break;
+		default:
+			asm __volatile__ (
+				"1:\n\t"
+				"movnti %2,(%0)\n\t"
+				"movnti %2,4(%0)\n\t"
+				"movnti %2,8(%0)\n\t"
+				"movnti %2,12(%0)\n\t"
+				"addl $16,%0\n\t"
+				"decl %1\n\t"
+				"jnz 1b\n\t"
+				"sfence\n\t"
+				: "+r" (p), "+r" (n)
+				: "r" (p1)
+				: "memory", "cc"
+			);
+			break;
+		}
+	}
+	asm __volatile__ (
+		"rep\n\t"
+		"stosl\n\t"
+		: "+c" (len), "+D" (p)
+		: "a" (p1)
+		: "memory"
+	);
+}
+
+/*
+ * The block move test can copy with any of these, the fastest one is
+ * found at startup and the others are used in turn on later passes.
+ */
+static char *copy_names[CE_MAX] = { "movsd", "movsb", "sse", "avx", "nt" };
+
+int copy_ok(int e)
+{
+	switch(e) {
+	case CE_MOVSD:
+	case CE_MOVSB:
+		return 1;
+	case CE_SSE:
+	case CE_NT:
+		return kvar[KV_COPY] >= SL_SSE2;
+	case CE_AVX:
+		return kvar[KV_COPY] >= SL_AVX;
+	}
+	return 0;
+}
+
+char *copy_name(int e)
+{
+	return copy_names[e];
+}
+
+/* The engine for this pass */
+int copy_engine(void)
+{
+	int e, n;
+
+	if (copy_sel && copy_ok(copy_sel - 1)) {
+		return copy_sel - 1;
+	}
+	for (e = 0, n = 0; e < CE_MAX; e++) {
+		n += copy_ok(e);
+	}
+	/* The pass is -1 after a test is picked from the menu */
+	n = (v->pass > 0 ? v->pass : 0) % n;
+	for (e = copy_best; ; e = (e + 1) % CE_MAX) {
+		if (copy_ok(e) && n-- == 0) {
+			return e;
+		}
+	}
+}
+
+/* Copy len words from s to d with engine e, the areas must not overlap */
+void copy_words(ulong *d, ulong *s, ulong len, int e)
+{
+	ulong n;
+
+	if (e == CE_MOVSB) {
+		len *= 4;
+		asm __volatile__ (
+			"cld\n\t"
+			"rep\n\t"
+			"movsb\n\t"
+			: "+D" (d), "+S" (s), "+c" (len)
+			:
+			: "memory"
+		);
+		return;
+	}
+	if (e >= CE_SSE && (((ulong)d | (ulong)s) & 15) == 0 && len >= 16) {
+		/* 64 bytes at a time, the rest is done with movsl */
+		n = len / 16;
+		len &= 15;
+		switch(e) {
+		case CE_SSE:
+			asm __volatile__ (
+				"1:\n\t"
+				"movdqa (%1),%%xmm0\n\t"
+				"movdqa 16(%1),%%xmm1\n\t"
+				"movdqa 32(%1),%%xmm2\n\t"
+				"movdqa 48(%1),%%xmm3\n\t"
+				"movdqa %%xmm0,(%0)\n\t"
+				"movdqa %%xmm1,16(%0)\n\t"
+				"movdqa %%xmm2,32(%0)\n\t"
+				"movdqa %%xmm3,48(%0)\n\t"
+				"addl $64,%0\n\t"
+				"addl $64,%1\n\t"
+				"decl %2\n\t"
+				"jnz 1b\n\t"
+				: "+r" (d), "+r" (s), "+r" (n)
+				:
+				: "memory", "cc"
+			);
+			break;
+		case CE_AVX:
+			asm __volatile__ (
+				"1:\n\t"
+				"vmovdqu (%1),%%ymm0\n\t"
+				"vmovdqu 32(%1),%%ymm1\n\t"
+				"vmovdqu %%ymm0,(%0)\n\t"
+				"vmovdqu %%ymm1,32(%0)\n\t"
+				"addl $64,%0\n\t"
+				"addl $64,%1\n\t"
+				"decl %2\n\t"
+				"jnz 1b\n\t"
+				"vzeroupper\n\t"
+				: "+r" (d), "+r" (s), "+r" (n)
+				:
+				: "memory", "cc"
+			);
+			break;
+		case CE_NT:
+			asm __volatile__ (
+				"1:\n\t"
+				"movdqa (%1),%%xmm0\n\t"
+				"movdqa 16(%1),%%xmm1\n\t"
+				"movdqa 32(%1),%%xmm2\n\t"
+				"movdqa 48(%1),%%xmm3\n\t"
+				"movntdq %%xmm0,(%0)\n\t"
+				"movntdq %%xmm1,16(%0)\n\t"
+				"movntdq %%xmm2,32(%0)\n\t"
+				"movntdq %%xmm3,48(%0)\n\t"
+				"addl $64,%0\n\t"
+				"addl $64,%1\n\t"
+				"decl %2\n\t"
+				"jnz 1b\n\t"
+				"sfence\n\t"
+				: "+r" (d), "+r" (s), "+r" (n)
+				:
+				: "memory", "cc"
+			);
+			break;
+		}
+	}
+	asm __volatile__ (
+		"cld\n\t"
+		"rep\n\t"
+		"movsl\n\t"
+		: "+D" (d), "+S" (s), "+c" (len)
+		:
+		: "memory"
+	);
+}
+
 /*
  * Memory address test, walking ones
  */
 void addr_tst1(int me)
 {
-	int i, j, k;
+	int i, j, k, c, bn, flush;
 	volatile ulong *p, *pt, *end;
-	ulong bad, mask, bank, p1;
+	ulong bad, mask, bank, p1, n = 0;
+
+	flush = addr_flush_ok();
+
+	/* With more than one CPU the banks are shared out and the global
+	 * address bits are only tested by the CPU with the first chunk */
+	c = chunk_index(me);
 
 	/* Test the global address bits */
 	for (p1=0, j=0; j<2; j++) {
+	    if (c == 0) {
         	hprint(LINE_PAT, COL_PAT, p1);
 
 		/* Set pattern in our lowest multiple of 0x20000 */
 		p = (ulong *)roundup((ulong)v->map[0].start, 0x1ffff);
 		*p = p1;
+		if (flush) {
+			addr_flush(p, p);
+		}
 	
 		/* Now write pattern compliment */
 		p1 = ~p1;
@@ -104,14 +384,21 @@ void addr_tst1(int me)
 					break;
 				}
 				*pt = p1;
+				if (flush) {
+					addr_flush(pt, p);
+				}
 				if ((bad = *p) != ~p1) {
 					ad_err1((ulong *)p, (ulong *)mask,
 						bad, ~p1);
 					i = 1000;
 				}
+				n++;
 				mask = mask << 1;
 			} while(mask);
 		}
+	    }
+		ACCT_RW(me, n*4);
+		n = 0;
 		do_tick(me);
 		BAILR
 	}
@@ -126,6 +413,7 @@ void addr_tst1(int me)
 	}
 	for (p1=0, k=0; k<2; k++) {
         	hprint(LINE_PAT, COL_PAT, p1);
+		bn = 0;
 
 		for (j=0; j<segs; j++) {
 			p = v->map[j].start;
@@ -134,7 +422,19 @@ void addr_tst1(int me)
 			end = v->map[j].end;
 			/* Redundant checks for overflow */
                         while (p < end && p > v->map[j].start && p != 0) {
+				/* Skip the banks that belong to the other CPUs */
+				if (run_cpus > 1 && bn++ % run_cpus != c) {
+					if (p + bank > p) {
+						p += bank;
+					} else {
+						p = end;
+					}
+					continue;
+				}
 				*p = p1;
+				if (flush) {
+					addr_flush(p, p);
+				}
 
 				p1 = ~p1;
 				for (i=0; i<50; i++) {
@@ -149,13 +449,21 @@ void addr_tst1(int me)
 						if (pt >= end) {
 							break;
 						}
+						/* Stay inside our own bank */
+						if (run_cpus > 1 && mask >= bank) {
+							break;
+						}
 						*pt = p1;
+						if (flush) {
+							addr_flush(pt, p);
+						}
 						if ((bad = *p) != ~p1) {
 							ad_err1((ulong *)p,
 							    (ulong *)mask,
 							    bad,~p1);
 							i = 200;
 						}
+						n++;
 						mask = mask << 1;
 					} while(mask);
 				}
@@ -167,6 +475,8 @@ void addr_tst1(int me)
 				p1 = ~p1;
 			}
 		}
+		ACCT_RW(me, n*4);
+		n = 0;
 		do_tick(me);
 		BAILR
 		p1 = ~p1;
@@ -176,7 +486,7 @@ void addr_tst1(int me)
 /*
  * Memory address test, own address
  */
-void addr_tst2(int me)
+void addr_tst2(int me, int split)
 {
 	int j, done;
 	ulong *p, *pe, *end, *start;
@@ -185,8 +495,12 @@ void addr_tst2(int me)
 
 	/* Write each address with it's own address */
 	for (j=0; j<segs; j++) {
-		start = v->map[j].start;
-		end = v->map[j].end;
+		if (split) {
+			calculate_chunk(&start, &end, me, j, 4);
+		} else {
+			start = v->map[j].start;
+			end = v->map[j].end;
+		}
 		pe = (ulong *)start;
 		p = start;
 		done = 0;
@@ -224,14 +538,19 @@ void addr_tst2(int me)
 				"jb L90\n\t"
 				: : "D" (p), "d" (pe)
 			);
+			ACCT_WR(me, (ulong)pe - (ulong)p + 4);
 			p = pe + 1;
 		} while (!done);
 	}
 
 	/* Each address should have its own address */
 	for (j=0; j<segs; j++) {
-		start = v->map[j].start;
-		end = v->map[j].end;
+		if (split) {
+			calculate_chunk(&start, &end, me, j, 4);
+		} else {
+			start = v->map[j].start;
+			end = v->map[j].end;
+		}
 		pe = (ulong *)start;
 		p = start;
 		done = 0;
@@ -287,6 +606,7 @@ void addr_tst2(int me)
 				: : "D" (p), "d" (pe)
 				: "ecx"
 			);
+			ACCT_RD(me, (ulong)pe - (ulong)p + 4);
 			p = pe + 1;
 		} while (!done);
 	}
@@ -300,11 +620,11 @@ void addr_tst2(int me)
  */
 void movinvr(int me)
 {
-	int i, j, done, seed1, seed2;
+	int i, j, done, seed1, seed2, nt = fill_nt_ok();
 	ulong *p;
 	ulong *pe;
 	ulong *start,*end;
-	ulong xorVal, chunk;
+	ulong xorVal;
 	//ulong num, bad;
 
 	/* Initialize memory with initial sequence of random numbers.  */
@@ -340,28 +660,12 @@ void movinvr(int me)
 			if (p == pe ) {
 				break;
 			}
-/* Original C code replaced with hand tuned assembly code */
-/*
-			for (; p <= pe; p++) {
-				*p = rand(me);
+			ACCT_WR(me, (ulong)pe - (ulong)p + 4);
+			if (nt) {
+				k_rand_fill_nt(p, pe, me);
+			} else {
+				k_rand_fill(p, pe, me);
 			}
- */
-
-                        asm __volatile__ (
-                                "jmp L200\n\t"
-                                ".p2align 4,,7\n\t"
-                                "L201:\n\t"
-                                "addl $4,%%edi\n\t"
-                                "L200:\n\t"
-				"pushl %%ecx\n\t" \
-                                "call rand\n\t"
-				"popl %%ecx\n\t" \
-				"movl %%eax,(%%edi)\n\t"
-                                "cmpl %%ebx,%%edi\n\t"
-                                "jb L201\n\t"
-                                : : "D" (p), "b" (pe), "c" (me)
-				: "eax"
-                        );
 			p = pe + 1;
 		} while (!done);
 	}
@@ -393,95 +697,13 @@ void movinvr(int me)
 				if (p == pe ) {
 					break;
 				}
-/* Original C code replaced with hand tuned assembly code */
-				
-				/*for (; p <= pe; p++) {
-					num = rand(me);
-					if (i) {
-						num = ~num;
-					}
-					if ((bad=*p) != num) {
-						error((ulong*)p, num, bad);
-					}
-					*p = ~num;
-				}*/
-
 				if (i) {
 					xorVal = 0xffffffff;
 				} else {
 					xorVal = 0;
 				}
-				asm __volatile__ (
-					
-                    "pushl %%ebp\n\t"
-
-					// Skip first increment
-					"jmp L26\n\t"
-					".p2align 4,,7\n\t"
-
-					// increment 4 bytes (32-bits)
-					"L27:\n\t"
-					"addl $4,%%edi\n\t"
-
-					// Check this byte
-					"L26:\n\t"
-
-					// Get next random number, pass in me(edx), random value returned in num(eax)
-					// num = rand(me);
-					// cdecl call maintains all registers except eax, ecx, and edx
-					// We maintain edx with a push and pop here using it also as an input
-					// we don't need the current eax value and want it to change to the return value
-					// we overwrite ecx shortly after this discarding its current value
-					"pushl %%edx\n\t" // Push function inputs onto stack
-					"call rand\n\t"
-					"popl %%edx\n\t" // Remove function inputs from stack
-
-					// XOR the random number with xorVal(ebx), which is either 0xffffffff or 0 depending on the outer loop
-					// if (i) { num = ~num; }
-					"xorl %%ebx,%%eax\n\t"
-
-					// Move the current value of the current position p(edi) into bad(ecx)
-					// (bad=*p)
-					"movl (%%edi),%%ecx\n\t"
-
-					// Compare bad(ecx) to num(eax)
-					"cmpl %%eax,%%ecx\n\t"
-
-					// If not equal jump the error case
-					"jne L23\n\t"
-
-					// Set a new value or not num(eax) at the current position p(edi)
-					// *p = ~num;
-					"L25:\n\t"
-					"movl $0xffffffff,%%ebp\n\t"
-					"xorl %%ebp,%%eax\n\t"
-					"movl %%eax,(%%edi)\n\t"
-
-					// Loop until current position p(edi) equals the end position pe(esi)
-					"cmpl %%esi,%%edi\n\t"
-					"jb L27\n\t"
-					"jmp L24\n"
-
-					// Error case
-					"L23:\n\t"
-					// Must manually maintain eax, ecx, and edx as part of cdecl call convention
-					"pushl %%edx\n\t"
-					"pushl %%ecx\n\t" // Next three pushes are functions input
-					"pushl %%eax\n\t"
-					"pushl %%edi\n\t"
-					"call error\n\t"
-					"popl %%edi\n\t" // Remove function inputs from stack and restore register values
-					"popl %%eax\n\t"
-					"popl %%ecx\n\t"
-					"popl %%edx\n\t"
-					"jmp L25\n" 
-
-					"L24:\n\t"
-                                        "popl %%ebp\n\t"
-					:: "D" (p), "S" (pe), "b" (xorVal),
-						 "d" (me)
-					: "eax", "ecx"
-				);
+				k_rand_inv(p, pe, xorVal, me);
+				ACCT_RW(me, (ulong)pe - (ulong)p + 4);
 				p = pe + 1;
 			} while (!done);
 		}
@@ -492,16 +714,115 @@ void movinvr(int me)
  * Test all of memory using a "moving inversions" algorithm using the
  * pattern in p1 and it's complement in p2.
  */
-void movinv1 (int iter, ulong p1, ulong p2, int me)
+/*
+ * Find region r of this CPU's part of the segments.  The regions are
+ * SPINSZ long, returns 0 when there is no such region.
+ */
+static int pipe_region(int me, int r, ulong **rs, ulong **re)
+{
+	int j;
+	ulong n, *start, *end;
+
+	for (j=0; j<segs; j++) {
+		calculate_chunk(&start, &end, me, j, 4);
+		if (end < start) {
+			continue;
+		}
+		n = (end - start) / SPINSZ + 1;
+		if (r < n) {
+			*rs = start + r * SPINSZ;
+			if (end - *rs < SPINSZ) {
+				*re = end;
+			} else {
+				*re = *rs + SPINSZ - 1;
+			}
+			return 1;
+		}
+		r -= n;
+	}
+	return 0;
+}
+
+/*
+ * Pipelined moving inversions.  The fill and each up and down pass are
+ * stages that are run region by region, with a region only moving to
+ * the next stage after the one before.  In each step every region that
+ * is in progress does one stage, so fills and checks are mixed instead
+ * of all of memory being in the same phase.  The CPUs start the stages
+ * of a step at different places so they are not all doing the same
+ * thing at once.  Only one tick, and its barrier, is taken per step.
+ */
+static void movinv1_pipe(int iter, ulong p1, ulong p2, int fuse, ulong pn,
+	int me)
 {
-	int i, j, done;
-	ulong *p, *pe, len, chunk, *start, *end, bad;
+	int t, s, k, ns, nr, lo, hi;
+	ulong *p, *pe, len;
+
+	/* Count the regions */
+	for (nr = 0; pipe_region(me, nr, &p, &pe); nr++)
+		;
+	ns = 1 + iter * 2;
+
+	for (t = 0; t < nr + ns - 1; t++) {
+		do_tick(me);
+		BAILR
+
+		/* Stages lo to hi have a region to work on in this step */
+		lo = t - nr + 1 > 0 ? t - nr + 1 : 0;
+		hi = t < ns - 1 ? t : ns - 1;
+		for (k = 0; k <= hi - lo; k++) {
+			s = lo + (k + me) % (hi - lo + 1);
+			if (!pipe_region(me, t - s, &p, &pe) || p == pe) {
+				continue;
+			}
+			len = pe - p + 1;
+			if (s == 0) {
+				if (fuse & FUSE_IN) {
+					continue;
+				}
+				ACCT_WR(me, len * 4);
+				asm __volatile__ (
+					"rep\n\t"
+					"stosl\n\t"
+					: "+c" (len), "+D" (p)
+					: "a" (p1)
+					: "memory"
+				);
+			} else if (s & 1) {
+				k_inv_up(p, pe, p1, p2);
+				ACCT_RW(me, len * 4);
+			} else {
+				k_inv_down(pe, p, p2, s == ns - 1 &&
+					(fuse & FUSE_OUT) ? pn : p1);
+				ACCT_RW(me, len * 4);
+			}
+		}
+	}
+}
+
+/*
+ * Moving inversions.  With FUSE_IN the fill is skipped because the last
+ * pass of the test before already left p1 in memory.  With FUSE_OUT the
+ * last down pass writes pn, the fill pattern of the next call, so that
+ * it can skip its fill.  The pattern written by the last pass is never
+ * checked by this call, so nothing is lost.
+ */
+void movinv1 (int iter, ulong p1, ulong p2, int fuse, ulong pn, int me)
+{
+	int i, j, done, nt = fill_nt_ok();
+	ulong *p, *pe, len, *start, *end, pw;
+
+	if (pipeline) {
+		if (mstr_cpu == me) hprint(LINE_PAT, COL_PAT, p1);
+		movinv1_pipe(iter, p1, p2, fuse, pn, me);
+		return;
+	}
 
 	/* Display the current pattern */
         if (mstr_cpu == me) hprint(LINE_PAT, COL_PAT, p1);
 
 	/* Initialize memory with the initial pattern.  */
-	for (j=0; j<segs; j++) {
+	for (j=0; j<segs && !(fuse & FUSE_IN); j++) {
 		calculate_chunk(&start, &end, me, j, 4);
 
 
@@ -527,17 +848,8 @@ void movinv1 (int iter, ulong p1, ulong p2, int me)
 				break;
 			}
 
-			//Original C code replaced with hand tuned assembly code
-			// seems broken
-			/*for (; p <= pe; p++) {
-				*p = p1;
-			}*/
-
-			asm __volatile__ (
-				"rep\n\t" \
-				"stosl\n\t"
-				: : "c" (len), "D" (p), "a" (p1)
-			);
+			fill_words(p, len, p1, nt);
+			ACCT_WR(me, len*4);
 
 			p = pe + 1;
 		} while (!done);
@@ -570,51 +882,12 @@ void movinv1 (int iter, ulong p1, ulong p2, int me)
 					break;
 				}
 
-				// Original C code replaced with hand tuned assembly code 
-				// seems broken
- 				/*for (; p <= pe; p++) {
-					if ((bad=*p) != p1) {
- 						error((ulong*)p, p1, bad);
- 					}
- 					*p = p2;
- 				}*/
-
-				asm __volatile__ (
-					"jmp L2\n\t" \
-					".p2align 4,,7\n\t" \
-					"L0:\n\t" \
-					"addl $4,%%edi\n\t" \
-					"L2:\n\t" \
-					"movl (%%edi),%%ecx\n\t" \
-					"cmpl %%eax,%%ecx\n\t" \
-					"jne L3\n\t" \
-					"L5:\n\t" \
-					"movl %%ebx,(%%edi)\n\t" \
-					"cmpl %%edx,%%edi\n\t" \
-					"jb L0\n\t" \
-					"jmp L4\n" \
-
-					"L3:\n\t" \
-					"pushl %%edx\n\t" \
-					"pushl %%ebx\n\t" \
-					"pushl %%ecx\n\t" \
-					"pushl %%eax\n\t" \
-					"pushl %%edi\n\t" \
-					"call error\n\t" \
-					"popl %%edi\n\t" \
-					"popl %%eax\n\t" \
-					"popl %%ecx\n\t" \
-					"popl %%ebx\n\t" \
-					"popl %%edx\n\t" \
-					"jmp L5\n" \
-
-					"L4:\n\t" \
-					:: "a" (p1), "D" (p), "d" (pe), "b" (p2)
-					: "ecx"
-				);
+				k_inv_up(p, pe, p1, p2);
+				ACCT_RW(me, (ulong)pe - (ulong)p + 4);
 				p = pe + 1;
 			} while (!done);
 		}
+		pw = (i == iter-1 && (fuse & FUSE_OUT)) ? pn : p1;
 		for (j=segs-1; j>=0; j--) {
 		    calculate_chunk(&start, &end, me, j, 4);
 			pe = end;
@@ -642,58 +915,231 @@ void movinv1 (int iter, ulong p1, ulong p2, int me)
 					break;
 				}
 
-				//Original C code replaced with hand tuned assembly code
-				// seems broken
-				/*do {
-					if ((bad=*p) != p2) {
-					error((ulong*)p, p2, bad);
-					}
-					*p = p1;
-				} while (--p >= pe);*/
-
-				asm __volatile__ (
-					"jmp L9\n\t"
-					".p2align 4,,7\n\t"
-					"L11:\n\t"
-					"subl $4, %%edi\n\t"
-					"L9:\n\t"
-					"movl (%%edi),%%ecx\n\t"
-					"cmpl %%ebx,%%ecx\n\t"
-					"jne L6\n\t"
-					"L10:\n\t"
-					"movl %%eax,(%%edi)\n\t"
-					"cmpl %%edi, %%edx\n\t"
-					"jne L11\n\t"
-					"jmp L7\n\t"
-
-					"L6:\n\t"
-					"pushl %%edx\n\t"
-					"pushl %%eax\n\t"
-					"pushl %%ecx\n\t"
-					"pushl %%ebx\n\t"
-					"pushl %%edi\n\t"
-					"call error\n\t"
-					"popl %%edi\n\t"
-					"popl %%ebx\n\t"
-					"popl %%ecx\n\t"
-					"popl %%eax\n\t"
-					"popl %%edx\n\t"
-					"jmp L10\n"
-
-					"L7:\n\t"
-					:: "a" (p1), "D" (p), "d" (pe), "b" (p2)
-					: "ecx"
-				);
+				k_inv_down(p, pe, p2, pw);
+				ACCT_RW(me, (ulong)p - (ulong)pe + 4);
 				p = pe - 1;
 			} while (!done);
 		}
 	}
 }
 
+/*
+ * Tile kernels for movinv32.  The pattern repeats every 32 words so it is
+ * kept in a 128 byte tile indexed by address, t[] has the pattern and c[]
+ * its complement.  The fill is done with 16 byte SSE2 stores, nothing is
+ * read until it is done so the order of the writes does not matter.  The
+ * up and down passes look the words up in the tile instead of shifting
+ * the pattern, but still read, check and write one word before the next
+ * as the march needs, the cache writes the lines back whole.
+ */
+static struct {
+	ulong t[32];
+	ulong c[32];
+} mv_tile[MAX_CPUS] __attribute__((aligned(128)));
+
+/* Build the tile from the pattern at p going up or down, returns 0 if
+ * the pattern does not repeat */
+static int mv32_tile(int me, ulong *p, int k, ulong pat, ulong b, ulong s,
+	int down)
+{
+	ulong *t = mv_tile[me].t, *c = mv_tile[me].c;
+	ulong a = (ulong)p >> 2, pat0 = pat;
+	int m, k0 = k;
+
+	for (m = 0; m < 32; m++) {
+		t[a & 31] = pat;
+		c[a & 31] = ~pat;
+		if (down) {
+			a--;
+			if (--k <= 0) {
+				pat = b;
+				k = 32;
+			} else {
+				pat = pat >> 1;
+				pat |= s;
+			}
+		} else {
+			a++;
+			if (++k >= 32) {
+				pat = b;
+				k = 0;
+			} else {
+				pat = pat << 1;
+				pat |= s;
+			}
+		}
+	}
+	return k == k0 && pat == pat0;
+}
+
+/* Fill n blocks of 16 bytes at p from the tile */
+static void tile_fill(ulong *p, ulong n, ulong *t)
+{
+	asm __volatile__ (
+		"1:\n\t"
+		"movl %0,%%eax\n\t"
+		"andl $127,%%eax\n\t"
+		"movdqa (%2,%%eax),%%xmm0\n\t"
+		"movntdq %%xmm0,(%0)\n\t"
+		"addl $16,%0\n\t"
+		"decl %1\n\t"
+		"jnz 1b\n\t"
+		"sfence\n\t"
+		: "+r" (p), "+r" (n)
+		: "r" (t)
+		: "eax", "memory", "cc"
+	);
+}
+
+/* Check up to n words going up from p against t[] and write c[], returns
+ * the number of words done before one did not match and that word in
+ * *bad */
+static ulong tile_up(ulong *p, ulong n, ulong *t, ulong *bad)
+{
+	ulong i = n, b = 0;
+
+	asm __volatile__ (
+		"jmp 2f\n"
+		"1:\n\t"
+		"movl %1,%%eax\n\t"
+		"andl $127,%%eax\n\t"
+		"movl (%1),%2\n\t"
+		"cmpl (%3,%%eax),%2\n\t"
+		"jne 3f\n\t"
+		"movl 128(%3,%%eax),%2\n\t"
+		"movl %2,(%1)\n\t"
+		"addl $4,%1\n\t"
+		"decl %0\n"
+		"2:\n\t"
+		"testl %0,%0\n\t"
+		"jnz 1b\n"
+		"3:\n\t"
+		: "+r" (i), "+r" (p), "+r" (b)
+		: "r" (t)
+		: "eax", "memory", "cc"
+	);
+	*bad = b;
+	return n - i;
+}
+
+/* The same going down from p, checking c[] and writing t[] */
+static ulong tile_down(ulong *p, ulong n, ulong *t, ulong *bad)
+{
+	ulong i = n, b = 0;
+
+	asm __volatile__ (
+		"jmp 2f\n"
+		"1:\n\t"
+		"movl %1,%%eax\n\t"
+		"andl $127,%%eax\n\t"
+		"movl (%1),%2\n\t"
+		"cmpl 128(%3,%%eax),%2\n\t"
+		"jne 3f\n\t"
+		"movl (%3,%%eax),%2\n\t"
+		"movl %2,(%1)\n\t"
+		"subl $4,%1\n\t"
+		"decl %0\n"
+		"2:\n\t"
+		"testl %0,%0\n\t"
+		"jnz 1b\n"
+		"3:\n\t"
+		: "+r" (i), "+r" (p), "+r" (b)
+		: "r" (t)
+		: "eax", "memory", "cc"
+	);
+	*bad = b;
+	return n - i;
+}
+
+/* Fill from p up to pe, the tile must have been built going up */
+static void mv32_fill(ulong *p, ulong *pe, int *kp, ulong *patp, ulong lb,
+	int sval, int me)
+{
+	ulong *t = mv_tile[me].t, pat = *patp, w, d;
+	int k = *kp;
+
+	for (w = pe - p + 1; w; ) {
+		if (((ulong)p & 15) == 0 && w >= 4) {
+			d = (w / 4) * 4;
+			tile_fill(p, d / 4, t);
+			p += d;
+			w -= d;
+			k = (k + d) & 31;
+			pat = t[((ulong)p >> 2) & 31];
+			if (w == 0) {
+				break;
+			}
+		}
+		do {
+			*p++ = pat;
+			w--;
+			if (++k >= 32) {
+				pat = lb;
+				k = 0;
+			} else {
+				pat = pat << 1;
+				pat |= sval;
+			}
+		} while (w && ((ulong)p & 15));
+	}
+	*kp = k;
+	*patp = pat;
+}
+
+/* Check for the pattern and write the complement from p up to pe */
+static void mv32_up(ulong *p, ulong *pe, int *kp, ulong *patp, int me)
+{
+	ulong *t = mv_tile[me].t, pat, w, d, bad;
+	int k = *kp;
+
+	for (w = pe - p + 1; w; ) {
+		d = tile_up(p, w, t, &bad);
+		p += d;
+		w -= d;
+		k = (k + d) & 31;
+		if (w == 0) {
+			break;
+		}
+		/* The word that did not match */
+		pat = t[((ulong)p >> 2) & 31];
+		error(p, pat, bad);
+		*p++ = ~pat;
+		w--;
+		k = (k + 1) & 31;
+	}
+	*kp = k;
+	*patp = t[((ulong)p >> 2) & 31];
+}
+
+/* Check for the complement and write the pattern from p down to pe */
+static void mv32_down(ulong *p, ulong *pe, int *kp, ulong *patp, int me)
+{
+	ulong *t = mv_tile[me].t, pat, w, d, bad;
+	int k = *kp;
+
+	for (w = p - pe + 1; w; ) {
+		d = tile_down(p, w, t, &bad);
+		p -= d;
+		w -= d;
+		k = ((k - 1 - d) & 31) + 1;
+		if (w == 0) {
+			break;
+		}
+		/* The word that did not match */
+		pat = t[((ulong)p >> 2) & 31];
+		error(p, ~pat, bad);
+		*p-- = pat;
+		w--;
+		k = ((k - 2) & 31) + 1;
+	}
+	*kp = k;
+	*patp = t[((ulong)p >> 2) & 31];
+}
+
 void movinv32(int iter, ulong p1, ulong lb, ulong hb, int sval, int off,int me)
 {
-	int i, j, k=0, n=0, done;
-	ulong *p, *pe, *start, *end, chunk, pat = 0, p3;
+	int i, j, k=0, n=0, done, tile = kvar[KV_TILE] >= SL_SSE2;
+	ulong *p, *pe, *start, *end, pat = 0, p3;
 
 	p3 = sval << 31;
 	/* Display the current pattern */
@@ -738,6 +1184,12 @@ void movinv32(int iter, ulong p1, ulong lb, ulong hb, int sval, int off,int me)
  *				p++;
  *			}
  */
+			ACCT_WR(me, (ulong)pe - (ulong)p + 4);
+			if (tile && mv32_tile(me, p, k, pat, lb, sval, 0)) {
+				mv32_fill(p, pe, &k, &pat, lb, sval, me);
+				p = pe + 1;
+				continue;
+			}
 			asm __volatile__ (
                                 "jmp L20\n\t"
                                 ".p2align 4,,7\n\t"
@@ -811,6 +1263,12 @@ void movinv32(int iter, ulong p1, ulong lb, ulong hb, int sval, int off,int me)
  *					}
  *				}
  */
+				ACCT_RW(me, (ulong)pe - (ulong)p + 4);
+				if (tile && mv32_tile(me, p, k, pat, lb, sval, 0)) {
+					mv32_up(p, pe, &k, &pat, me);
+					p = pe + 1;
+					continue;
+				}
 				asm __volatile__ (
                                         "pushl %%ebp\n\t"
                                         "jmp L30\n\t"
@@ -920,6 +1378,12 @@ void movinv32(int iter, ulong p1, ulong lb, ulong hb, int sval, int off,int me)
  *					}
  *				};
  */
+				ACCT_RW(me, (ulong)p - (ulong)pe + 4);
+				if (tile && mv32_tile(me, p, k, pat, hb, p3, 1)) {
+					mv32_down(p, pe, &k, &pat, me);
+					p = pe - 1;
+					continue;
+				}
 				asm __volatile__ (
                                         "pushl %%ebp\n\t"
                                         "jmp L40\n\t"
@@ -982,12 +1446,88 @@ void movinv32(int iter, ulong p1, ulong lb, ulong hb, int sval, int off,int me)
 /*
  * Test all of memory using modulo X access pattern.
  */
+/*
+ * Write p2 to the words from p to pe except every MOD_SZ'th one, k is the
+ * position of p in the MOD_SZ word period.  Whole periods are written
+ * with non-temporal 16 byte stores and single stores for the three words
+ * next to the one that is skipped.  Returns the position after pe.
+ *
+ * Unlike the moving inversions this pass only writes, and the check that
+ * follows reads only the skipped words.  What it finds is the disturbance
+ * from all of the writes around them, which does not depend on the order
+ * of the writes, so they can go out a block at a time.
+ */
+static int mod_fill(ulong *p, ulong *pe, int k, int offset, ulong p2)
+{
+	ulong w, n, bo, o1, o2, o3;
+
+	bo = (offset / 4) * 16;
+	o1 = bo + ((offset + 1) & 3) * 4;
+	o2 = bo + ((offset + 2) & 3) * 4;
+	o3 = bo + ((offset + 3) & 3) * 4;
+	for (w = pe - p + 1; w; ) {
+		if (k == 0 && ((ulong)p & 15) == 0 && w >= MOD_SZ) {
+			n = w / MOD_SZ;
+			w -= n * MOD_SZ;
+			asm __volatile__ (
+				"movd %2,%%xmm0\n\t"
+				"pshufd $0,%%xmm0,%%xmm0\n"
+				"1:\n\t"
+				"cmpl $0,%6\n\t"
+				"je 2f\n\t"
+				"movntdq %%xmm0,(%0)\n"
+				"2:\n\t"
+				"cmpl $16,%6\n\t"
+				"je 3f\n\t"
+				"movntdq %%xmm0,16(%0)\n"
+				"3:\n\t"
+				"cmpl $32,%6\n\t"
+				"je 4f\n\t"
+				"movntdq %%xmm0,32(%0)\n"
+				"4:\n\t"
+				"cmpl $48,%6\n\t"
+				"je 5f\n\t"
+				"movntdq %%xmm0,48(%0)\n"
+				"5:\n\t"
+				"cmpl $64,%6\n\t"
+				"je 6f\n\t"
+				"movntdq %%xmm0,64(%0)\n"
+				"6:\n\t"
+				"movnti %2,(%0,%3)\n\t"
+				"movnti %2,(%0,%4)\n\t"
+				"movnti %2,(%0,%5)\n\t"
+				"addl $80,%0\n\t"
+				"decl %1\n\t"
+				"jnz 1b\n\t"
+				"sfence\n\t"
+				: "+r" (p), "+r" (n)
+				: "r" (p2), "r" (o1), "r" (o2), "r" (o3), "m" (bo)
+				: "memory", "cc"
+			);
+			if (w == 0) {
+				break;
+			}
+		}
+		do {
+			if (k != offset) {
+				*p = p2;
+			}
+			p++;
+			w--;
+			if (++k > MOD_SZ-1) {
+				k = 0;
+			}
+		} while (w && k);
+	}
+	return k;
+}
+
 void modtst(int offset, int iter, ulong p1, ulong p2, int me)
 {
-	int j, k, l, done;
+	int j, k, l, done, nt = fill_nt_ok(), tile = kvar[KV_TILE] >= SL_SSE2;
 	ulong *p;
 	ulong *pe;
-	ulong *start, *end, chunk;
+	ulong *start, *end;
 
 	/* Display the current pattern */
         if (mstr_cpu == me) {
@@ -998,7 +1538,7 @@ void modtst(int offset, int iter, ulong p1, ulong p2, int me)
 
 	/* Write every nth location with pattern */
 	for (j=0; j<segs; j++) {
-		calculate_chunk(&start, &end, me, j, 4);
+		calculate_chunk(&start, &end, me, j, 16);
 		end -= MOD_SZ;	/* adjust the ending address */
 		pe = (ulong *)start;
 		p = start+offset;
@@ -1020,30 +1560,19 @@ void modtst(int offset, int iter, ulong p1, ulong p2, int me)
 			if (p == pe ) {
 				break;
 			}
-/* Original C code replaced with hand tuned assembly code
- *			for (; p <= pe; p += MOD_SZ) {
- *				*p = p1;
- *			}
- */
-			asm __volatile__ (
-				"jmp L60\n\t" \
-				".p2align 4,,7\n\t" \
-
-				"L60:\n\t" \
-				"movl %%eax,(%%edi)\n\t" \
-				"addl $80,%%edi\n\t" \
-				"cmpl %%edx,%%edi\n\t" \
-				"jb L60\n\t" \
-				: "=D" (p)
-				: "D" (p), "d" (pe), "a" (p1)
-			);
+			ACCT_WR(me, ((ulong)pe - (ulong)p) / MOD_SZ + 4);
+			if (nt) {
+				p = k_mod_fill_nt(p, pe, p1);
+			} else {
+				p = k_mod_fill(p, pe, p1);
+			}
 		} while (!done);
 	}
 
 	/* Write the rest of memory "iter" times with the pattern complement */
 	for (l=0; l<iter; l++) {
 		for (j=0; j<segs; j++) {
-			calculate_chunk(&start, &end, me, j, 4);
+			calculate_chunk(&start, &end, me, j, 16);
 			pe = (ulong *)start;
 			p = start;
 			done = 0;
@@ -1065,38 +1594,13 @@ void modtst(int offset, int iter, ulong p1, ulong p2, int me)
 				if (p == pe ) {
 					break;
 				}
-/* Original C code replaced with hand tuned assembly code
- *				for (; p <= pe; p++) {
- *					if (k != offset) {
- *						*p = p2;
- *					}
- *					if (++k > MOD_SZ-1) {
- *						k = 0;
- *					}
- *				}
- */
-				asm __volatile__ (
-					"jmp L50\n\t" \
-					".p2align 4,,7\n\t" \
-
-					"L54:\n\t" \
-					"addl $4,%%edi\n\t" \
-					"L50:\n\t" \
-					"cmpl %%ebx,%%ecx\n\t" \
-					"je L52\n\t" \
-					  "movl %%eax,(%%edi)\n\t" \
-					"L52:\n\t" \
-					"incl %%ebx\n\t" \
-					"cmpl $19,%%ebx\n\t" \
-					"jle L53\n\t" \
-					  "xorl %%ebx,%%ebx\n\t" \
-					"L53:\n\t" \
-					"cmpl %%edx,%%edi\n\t" \
-					"jb L54\n\t" \
-					: "=b" (k)
-					: "D" (p), "d" (pe), "a" (p2),
-						"b" (k), "c" (offset)
-				);
+				ACCT_WR(me, ((ulong)pe - (ulong)p + 4) /
+					MOD_SZ * (MOD_SZ-1));
+				if (tile) {
+					k = mod_fill(p, pe, k, offset, p2);
+				} else {
+					k = k_mod_skip(p, pe, p2, k, offset);
+				}
 				p = pe + 1;
 			} while (!done);
 		}
@@ -1104,7 +1608,7 @@ void modtst(int offset, int iter, ulong p1, ulong p2, int me)
 
 	/* Now check every nth location */
 	for (j=0; j<segs; j++) {
-		calculate_chunk(&start, &end, me, j, 4);
+		calculate_chunk(&start, &end, me, j, 16);
 		pe = (ulong *)start;
 		p = start+offset;
 		done = 0;
@@ -1126,44 +1630,8 @@ void modtst(int offset, int iter, ulong p1, ulong p2, int me)
 			if (p == pe ) {
 				break;
 			}
-/* Original C code replaced with hand tuned assembly code
- *			for (; p <= pe; p += MOD_SZ) {
- *				if ((bad=*p) != p1) {
- *					error((ulong*)p, p1, bad);
- *				}
- *			}
- */
-			asm __volatile__ (
-				"jmp L70\n\t" \
-				".p2align 4,,7\n\t" \
-
-				"L70:\n\t" \
-				"movl (%%edi),%%ecx\n\t" \
-				"cmpl %%eax,%%ecx\n\t" \
-				"jne L71\n\t" \
-				"L72:\n\t" \
-				"addl $80,%%edi\n\t" \
-				"cmpl %%edx,%%edi\n\t" \
-				"jb L70\n\t" \
-				"jmp L73\n\t" \
-
-				"L71:\n\t" \
-				"pushl %%edx\n\t"
-				"pushl %%ecx\n\t"
-				"pushl %%eax\n\t"
-				"pushl %%edi\n\t"
-				"call error\n\t"
-				"popl %%edi\n\t"
-				"popl %%eax\n\t"
-				"popl %%ecx\n\t"
-				"popl %%edx\n\t"
-				"jmp L72\n"
-
-				"L73:\n\t" \
-				: "=D" (p)
-				: "D" (p), "d" (pe), "a" (p1)
-				: "ecx"
-			);
+			ACCT_RD(me, ((ulong)pe - (ulong)p) / MOD_SZ + 4);
+			p = k_mod_chk(p, pe, p1);
 		} while (!done);
 	}
 }
@@ -1174,12 +1642,15 @@ void modtst(int offset, int iter, ulong p1, ulong p2, int me)
  */
 void block_move(int iter, int me)
 {
-	int i, j, done;
+	int i, j, done, nt = fill_nt_ok(), e;
 	ulong len;
 	ulong *p, *pe, pp;
-	ulong *start, *end, chunk;
+	ulong *start, *end;
 
+	BAILR
+	e = copy_engine();
         cprint(LINE_PAT, COL_PAT-2, "          ");
+	if (mstr_cpu == me) cprint(LINE_PAT, COL_PAT, copy_name(e));
 
 	/* Initialize memory with the initial pattern.  */
 	for (j=0; j<segs; j++) {
@@ -1211,6 +1682,41 @@ void block_move(int iter, int me)
 			else
 				len  = ((ulong)(pe + 1) - (ulong)p) / 64;
 			//len++;
+			if (nt) {
+				/* The same fill with non-temporal stores */
+				ACCT_WR(me, len*64);
+				pp = 1;
+				asm __volatile__ (
+					"1:\n\t"
+					"movl %%eax, %%edx\n\t"
+					"notl %%edx\n\t"
+					"movnti %%eax,0(%%edi)\n\t"
+					"movnti %%eax,4(%%edi)\n\t"
+					"movnti %%eax,8(%%edi)\n\t"
+					"movnti %%eax,12(%%edi)\n\t"
+					"movnti %%edx,16(%%edi)\n\t"
+					"movnti %%edx,20(%%edi)\n\t"
+					"movnti %%eax,24(%%edi)\n\t"
+					"movnti %%eax,28(%%edi)\n\t"
+					"movnti %%eax,32(%%edi)\n\t"
+					"movnti %%eax,36(%%edi)\n\t"
+					"movnti %%edx,40(%%edi)\n\t"
+					"movnti %%edx,44(%%edi)\n\t"
+					"movnti %%eax,48(%%edi)\n\t"
+					"movnti %%eax,52(%%edi)\n\t"
+					"movnti %%edx,56(%%edi)\n\t"
+					"movnti %%edx,60(%%edi)\n\t"
+					"rcll $1, %%eax\n\t"
+					"leal 64(%%edi), %%edi\n\t"
+					"decl %%ecx\n\t"
+					"jnz 1b\n\t"
+					"sfence\n\t"
+					: "+D" (p), "+c" (len), "+a" (pp)
+					:
+					: "edx", "memory", "cc"
+				);
+				continue;
+			}
 			asm __volatile__ (
 				"jmp L100\n\t"
 
@@ -1255,6 +1761,7 @@ void block_move(int iter, int me)
 				: "D" (p), "c" (len), "a" (1)
 				: "edx"
 			);
+			ACCT_WR(me, len*64);
 		} while (!done);
 	}
 	s_barrier();
@@ -1299,45 +1806,24 @@ void block_move(int iter, int me)
 			for(i=0; i<iter; i++) {
 				do_tick(me);
 				BAILR
-				asm __volatile__ (
-					"cld\n"
-					"jmp L110\n\t"
-
-					".p2align 4,,7\n\t"
-					"L110:\n\t"
-
-					//
-					// At the end of all this 
-					// - the second half equals the inital value of the first half
-					// - the first half is right shifted 32-bytes (with wrapping)
-					//
-
-					// Move first half to second half
-					"movl %1,%%edi\n\t" // Destionation, pp (mid point)
-					"movl %0,%%esi\n\t" // Source, p (start point)
-					"movl %2,%%ecx\n\t" // Length, len (size of a half in DWORDS)
-					"rep\n\t"
-					"movsl\n\t"
-
-					// Move the second half, less the last 32-bytes. To the first half, offset plus 32-bytes
-					"movl %0,%%edi\n\t"
-					"addl $32,%%edi\n\t"	// Destination, p(start-point) plus 32 bytes
-					"movl %1,%%esi\n\t"		// Source, pp(mid-point)
-					"movl %2,%%ecx\n\t"
-					"subl $8,%%ecx\n\t"		// Length, len(size of a half in DWORDS) minus 8 DWORDS (32 bytes)
-					"rep\n\t"
-					"movsl\n\t"
+				/*
+				 * At the end of all this
+				 * - the second half equals the inital value of the first half
+				 * - the first half is right shifted 32-bytes (with wrapping)
+				 */
 
-					// Move last 8 DWORDS (32-bytes) of the second half to the start of the first half
-					"movl %0,%%edi\n\t"		// Destination, p(start-point)
-											// Source, 8 DWORDS from the end of the second half, left over by the last rep/movsl
-					"movl $8,%%ecx\n\t"		// Length, 8 DWORDS (32-bytes)
-					"rep\n\t"
-					"movsl\n\t"
+				/* Move first half to second half */
+				copy_words((ulong *)pp, p, len, e);
 
-					:: "g" (p), "g" (pp), "g" (len)
-					: "edi", "esi", "ecx"
-				);
+				/* Move the second half, less the last 32-bytes,
+				 * to the first half plus 32-bytes */
+				copy_words(p + 8, (ulong *)pp, len - 8, e);
+
+				/* Move the last 32-bytes of the second half to
+				 * the start of the first half */
+				copy_words(p, (ulong *)pp + len - 8, 8, e);
+
+				ACCT_RW(me, len*8);
 			}
 			p = pe;
 		} while (!done);
@@ -1376,6 +1862,7 @@ void block_move(int iter, int me)
 			else
 				pe-=2;	/* the last dwords to test are pe[0] and pe[1] */
 
+			ACCT_RD(me, (ulong)pe - (ulong)p + 8);
 			asm __volatile__ (
 				"jmp L120\n\t"
 
@@ -1416,23 +1903,122 @@ void block_move(int iter, int me)
 	}
 }
 
+/*
+ * Bit fade timing for each CPU.  The check is paced to the speed of the
+ * fill so that every word is held for about the same time.
+ */
+static struct {
+	uint64_t fill_clks;
+	uint64_t fill_bytes;
+	uint64_t chk_clks;
+	uint64_t chk_bytes;
+	ulong cpk;			/* Fill clocks per KB */
+	int chk;			/* Checking */
+} bf[MAX_CPUS];
+
+/* Check the words from p to pe, 32 bytes at a time with SSE2 or 64 with
+ * AVX2 */
+static void fade_check(ulong *p, ulong *pe, ulong p1)
+{
+	ulong n, m, w, bad, *pb;
+
+	if (kvar[KV_CHECK] >= SL_SSE2) {
+		/* Words per block, the blocks are aligned to half of that */
+		w = kvar[KV_CHECK] == SL_AVX2 ? 16 : 8;
+		for (; ((ulong)p & (w * 2 - 1)) && p <= pe; p++) {
+			if ((bad = *p) != p1) {
+				error(p, p1, bad);
+			}
+		}
+		n = (pe - p + 1) / w;
+		while (n) {
+			if (w == 16) {
+				asm __volatile__ (
+					"vmovd %3,%%xmm0\n\t"
+					"vpbroadcastd %%xmm0,%%ymm0\n\t"
+					"1:\n\t"
+					"vpcmpeqd (%0),%%ymm0,%%ymm1\n\t"
+					"vpcmpeqd 32(%0),%%ymm0,%%ymm2\n\t"
+					"vpand %%ymm2,%%ymm1,%%ymm1\n\t"
+					"vpmovmskb %%ymm1,%2\n\t"
+					"cmpl $-1,%2\n\t"
+					"jne 2f\n\t"
+					"addl $64,%0\n\t"
+					"decl %1\n\t"
+					"jnz 1b\n"
+					"2:\n\t"
+					"vzeroupper\n\t"
+					: "+r" (p), "+r" (n), "=&r" (m)
+					: "r" (p1)
+					: "memory", "cc"
+				);
+			} else {
+				asm __volatile__ (
+					"movd %3,%%xmm0\n\t"
+					"pshufd $0,%%xmm0,%%xmm0\n\t"
+					"1:\n\t"
+					"movdqa (%0),%%xmm1\n\t"
+					"movdqa 16(%0),%%xmm2\n\t"
+					"pcmpeqd %%xmm0,%%xmm1\n\t"
+					"pcmpeqd %%xmm0,%%xmm2\n\t"
+					"pand %%xmm2,%%xmm1\n\t"
+					"pmovmskb %%xmm1,%2\n\t"
+					"cmpl $0xffff,%2\n\t"
+					"jne 2f\n\t"
+					"addl $32,%0\n\t"
+					"decl %1\n\t"
+					"jnz 1b\n"
+					"2:\n\t"
+					: "+r" (p), "+r" (n), "=&r" (m)
+					: "r" (p1)
+					: "memory", "cc"
+				);
+			}
+			if (n == 0) {
+				break;
+			}
+
+			/* Something is different in this block, find it */
+			for (pb = p + w; p < pb; p++) {
+				if ((bad = *p) != p1) {
+					error(p, p1, bad);
+				}
+			}
+			n--;
+		}
+	}
+	for (; p <= pe; p++) {
+		if ((bad = *p) != p1) {
+			error(p, p1, bad);
+		}
+	}
+}
+
 /*
  * Test memory for bit fade, fill memory with pattern.
  */
 void bit_fade_fill(ulong p1, int me)
 {
 	int j, done;
-	ulong *p, *pe;
+	ulong *p, *pe, len;
 	ulong *start,*end;
+	uint64_t t;
 
 	/* Display the current pattern */
-	hprint(LINE_PAT, COL_PAT, p1);
+	if (mstr_cpu == me) hprint(LINE_PAT, COL_PAT, p1);
+
+	/* A new fill, start the timing over */
+	if (bf[me].chk || bf[me].fill_bytes == 0) {
+		bf[me].fill_clks = bf[me].fill_bytes = 0;
+		bf[me].chk_clks = bf[me].chk_bytes = 0;
+		bf[me].chk = 0;
+	}
+	t = get_tsc();
 
 	/* Initialize memory with the initial pattern.  */
 	for (j=0; j<segs; j++) {
-		start = v->map[j].start;
-		end = v->map[j].end;
-		pe = (ulong *)start;
+		calculate_chunk(&start, &end, me, j, 64);
+		pe = start;
 		p = start;
 		done = 0;
 		do {
@@ -1452,26 +2038,38 @@ void bit_fade_fill(ulong p1, int me)
 			if (p == pe ) {
 				break;
 			}
- 			for (; p < pe;) {
-				*p = p1;
-				p++;
-			}
+			len = pe - p + 1;
+			fill_words(p, len, p1, fill_nt_ok());
+			ACCT_WR(me, len*4);
+			bf[me].fill_bytes += len*4;
 			p = pe + 1;
 		} while (!done);
 	}
+	bf[me].fill_clks += get_tsc() - t;
 }
 
 void bit_fade_chk(ulong p1, int me)
 {
 	int j, done;
-	ulong *p, *pe, bad;
+	ulong *p, *pe, len;
 	ulong *start,*end;
+	uint64_t t, t0;
+
+	/* Work out the fill speed */
+	if (!bf[me].chk) {
+		bf[me].chk = 1;
+		bf[me].cpk = 0;
+		if (bf[me].fill_bytes >> 10) {
+			bf[me].cpk = udiv64(bf[me].fill_clks,
+				bf[me].fill_bytes >> 10);
+		}
+	}
+	t0 = get_tsc();
 
 	/* Make sure that nothing changed while sleeping */
 	for (j=0; j<segs; j++) {
-		start = v->map[j].start;
-		end = v->map[j].end;
-		pe = (ulong *)start;
+		calculate_chunk(&start, &end, me, j, 64);
+		pe = start;
 		p = start;
 		done = 0;
 		do {
@@ -1491,54 +2089,299 @@ void bit_fade_chk(ulong p1, int me)
 			if (p == pe ) {
 				break;
 			}
- 			for (; p < pe;) {
- 				if ((bad=*p) != p1) {
-					error((ulong*)p, p1, bad);
-				}
-				p++;
-			}
+
+			/* Don't get ahead of the fill */
+			do {
+				t = bf[me].chk_clks + get_tsc() - t0;
+			} while (t < (bf[me].chk_bytes >> 10) * bf[me].cpk);
+
+			len = pe - p + 1;
+			fade_check(p, pe, p1);
+			ACCT_RD(me, len*4);
+			bf[me].chk_bytes += len*4;
 			p = pe + 1;
 		} while (!done);
 	}
+	bf[me].chk_clks += get_tsc() - t0;
+}
+
+/*
+ * Row hammer.  Two addresses in the same bank but in different rows are
+ * read over and over with their lines flushed, so that each read opens
+ * its row and closes the other one.  The rows next to them can lose
+ * charge if the DRAM is not refreshed often enough.  A pair in one bank
+ * differs only in a row bit of the DRAM map (dram.c).  Without a map it
+ * is found by timing, it is the slowest since every read has to wait for
+ * the other row to close.  The "hammer=" option gives the distance
+ * between the two instead.
+ */
+#define HAM_TRY		64	/* Candidates timed for each pair */
+#define HAM_TIME	64	/* Reads of each candidate */
+
+extern ulong ham_dist;
+
+static struct {
+	uint64_t acts;		/* Row activations */
+	uint64_t clks;		/* Clocks spent hammering */
+	ulong pairs;		/* Pairs hammered */
+	ulong found;		/* Pairs known to be in one bank */
+} ham[MAX_CPUS];
+
+/* Pick the other address of a pair for a, from p to pe */
+static ulong *ham_other(ulong *a, ulong *p, ulong *pe, int me)
+{
+	ulong *b, *best = NULL;
+	uint64_t t, tmin = ~0ULL, tmax = 0;
+	int i, k;
+
+	if (ham_dist) {
+		b = a + ham_dist / 4;
+		if (b > a && b <= pe) {
+			return b;
+		}
+		b = a - ham_dist / 4;
+		return b >= p && b < a ? b : NULL;
+	}
+	for (i = 0; dram_rows && i < HAM_TRY; i++) {
+		k = rand(me) & 31;
+		b = (ulong *)((ulong)a ^ (1UL << k));
+		if ((dram_rows >> k & 1) && b >= p && b <= pe &&
+				dram_phys(b) == (dram_phys(a) ^ (1ULL << k))) {
+			ham[me].found++;
+			return b;
+		}
+	}
+	for (i = 0; i < HAM_TRY; i++) {
+		b = p + ((rand(me) % (pe - p + 1)) & ~15);
+		t = dram_pair(a, b, HAM_TIME);
+		if (t < tmin) {
+			tmin = t;
+		}
+		if (t > tmax) {
+			tmax = t;
+			best = b;
+		}
+	}
+	if (tmax > tmin + tmin / 8) {
+		ham[me].found++;
+	}
+	return best;
 }
 
-/* Sleep for N seconds */
+void hammer(int iter, int me)
+{
+	int j, k, done;
+	ulong *p, *pe, *a, *b, *start, *end, p1, len, n;
+
+	if (!addr_flush_ok()) {
+		return;
+	}
+	rand_seed(get_tsc() + me, 362436069 - v->pass, me);
+
+	for (p1 = 0, k = 0; k < 2; k++, p1 = ~p1) {
+		if (mstr_cpu == me) hprint(LINE_PAT, COL_PAT, p1);
+		for (j=0; j<segs; j++) {
+			calculate_chunk(&start, &end, me, j, 64);
+			pe = start;
+			p = start;
+			done = 0;
+			do {
+				do_tick(me);
+				BAILR
+
+				/* Check for overflow */
+				if (pe + SPINSZ > pe && pe != 0) {
+					pe += SPINSZ;
+				} else {
+					pe = end;
+				}
+				if (pe >= end) {
+					pe = end;
+					done++;
+				}
+				if (p == pe ) {
+					break;
+				}
+				len = pe - p + 1;
+				fill_words(p, len, p1, fill_nt_ok());
+
+				/* iter pairs for a full chunk */
+				n = (iter * (len >> 10) + (SPINSZ >> 10) - 1) /
+					(SPINSZ >> 10);
+				for (; n > 0 && len > 16; n--) {
+					a = p + ((rand(me) % len) & ~15);
+					if ((b = ham_other(a, p, pe, me)) == NULL) {
+						continue;
+					}
+					ham[me].clks += dram_pair(a, b, HAM_LOOPS);
+					ham[me].acts += 2 * HAM_LOOPS;
+					ham[me].pairs++;
+					ACCT_RD(me, 128 * HAM_LOOPS);
+				}
+				fade_check(p, pe, p1);
+				ACCT_RW(me, len*4);
+				p = pe + 1;
+			} while (!done);
+		}
+	}
+}
+
+/*
+ * Show the activations per 64 ms refresh window of one pair, so that it
+ * can be seen if the hammer is fast enough to disturb anything.  Called
+ * by the master CPU after the test.
+ */
+void hammer_report(void)
+{
+	uint64_t acts = 0, clks = 0;
+	ulong pairs = 0, found = 0, ms;
+	int i, y;
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		acts += ham[i].acts;
+		clks += ham[i].clks;
+		pairs += ham[i].pairs;
+		found += ham[i].found;
+		ham[i].acts = ham[i].clks = 0;
+		ham[i].pairs = ham[i].found = 0;
+	}
+	if ((ms = udiv64(clks, v->clks_msec)) == 0 ||
+			(y = report_line()) < 0) {
+		return;
+	}
+	cprint(y, 0, "Hammer:          activations per 64 ms,"
+		"        pairs,");
+	dprint(y, 8, udiv64(acts * 64, ms), 8, 0);
+	dprint(y, 40, pairs, 7, 0);
+	if (ham_dist) {
+		cprint(y, 55, "distance");
+		hprint(y, 64, ham_dist);
+	} else {
+		dprint(y, 55, found, 7, 0);
+		cprint(y, 63, "in one bank");
+	}
+}
+
+/*
+ * Find piece k of the np SPINSZ pieces of the part from start to end,
+ * the last piece runs to the end.  Returns 0 when the part is shorter.
+ */
+static int cross_piece(ulong *start, ulong *end, int k, int np,
+	ulong **p, ulong **pe)
+{
+	if (end < start || (ulong)(end - start) < (ulong)k * SPINSZ) {
+		return 0;
+	}
+	*p = start + k * SPINSZ;
+	if (k == np - 1 || end - *p < SPINSZ) {
+		*pe = end;
+	} else {
+		*pe = *p + SPINSZ - 1;
+	}
+	return 1;
+}
+
+/*
+ * Cross CPU test.  Each CPU fills its own part of memory and then checks
+ * the part that another CPU filled, so the paths between the CPUs and to
+ * the memory of the other sockets are tested.  The CPUs are usually
+ * numbered one socket after the other, so the one half way round is
+ * first and the rest follow in turn.  Errors show the CPU that wrote
+ * the memory as well as the one that read it.
+ */
+void cross_cpu(int iter, int me)
+{
+	int i, j, k, np, s, w, n = run_cpus, cpu = smp_ord_to_cpu(me);
+	int nt = fill_nt_ok();
+	ulong *start, *end, *ws, *we, *p, *pe, p1;
+
+	for (i = 0; i < iter; i++) {
+		/* The writer of the part we check */
+		s = n > 1 ? (n / 2 - 1 + i) % (n - 1) + 1 : 0;
+		w = (me + s) % n;
+		p1 = i & 1 ? 0xaaaaaaaa : 0x55555555;
+		if (mstr_cpu == me) hprint(LINE_PAT, COL_PAT, p1);
+		for (j = 0; j < segs; j++) {
+			/* Every CPU counts the pieces of the first part, so
+			 * they all tick and wait at the barriers as often */
+			calculate_chunk(&start, &end, 0, j, 64);
+			np = end < start ? 0 : (end - start) / SPINSZ + 1;
+			calculate_chunk(&start, &end, me, j, 64);
+			calculate_chunk(&ws, &we, w, j, 64);
+
+			for (k = 0; k < np; k++) {
+				do_tick(me);
+				BAILR
+
+				if (cross_piece(start, end, k, np, &p, &pe)) {
+					fill_words(p, pe - p + 1, p1, nt);
+					ACCT_WR(me, (pe - p + 1) * 4);
+				}
+				s_barrier();
+
+				if (cross_piece(ws, we, k, np, &p, &pe)) {
+					if (w != me) {
+						err_writer[cpu] =
+							smp_ord_to_cpu(w) + 1;
+					}
+					fade_check(p, pe, p1);
+					err_writer[cpu] = 0;
+					ACCT_RD(me, (pe - p + 1) * 4);
+				}
+
+				/* Don't refill our part until it has been
+				 * checked */
+				s_barrier();
+			}
+		}
+	}
+}
+
+/*
+ * Sleep for N seconds.  If flag is set the CPUs tick once a second, only
+ * the master CPU times the wait and the others wait for it in do_tick(),
+ * so that they all tick N times whatever their clocks say.
+ */
 void sleep(long n, int flag, int me)
 {
-	ulong sh, sl, l, h, t, ip=0;
+	ulong sh, sl, l, h, t;
+	long i;
 
 	/* save the starting time */
 	asm __volatile__(
 		"rdtsc":"=a" (sl),"=d" (sh));
+	if (me == mstr_cpu) {
+		stat_idle(1);
+	}
 
-	/* loop for n seconds */
-	while (1) {
-		asm __volatile__(
-			"rep ; nop\n\t"
-			"rdtsc":"=a" (l),"=d" (h));
-		asm __volatile__ (
-			"subl %2,%0\n\t"
-			"sbbl %3,%1"
-			:"=a" (l), "=d" (h)
-			:"g" (sl), "g" (sh),
-			"0" (l), "1" (h));
-		t = h * ((unsigned)0xffffffff / v->clks_msec) / 1000;
-		t += (l / v->clks_msec) / 1000;
-
-		/* Is the time up? */
-		if (t >= n) {
-			break;
+	for (i = 1; i <= n; i++) {
+		/* wait until i seconds have gone by */
+		while (!flag || me == mstr_cpu) {
+			asm __volatile__(
+				"rep ; nop\n\t"
+				"rdtsc":"=a" (l),"=d" (h));
+			asm __volatile__ (
+				"subl %2,%0\n\t"
+				"sbbl %3,%1"
+				:"=a" (l), "=d" (h)
+				:"g" (sl), "g" (sh),
+				"0" (l), "1" (h));
+			t = h * ((unsigned)0xffffffff / v->clks_msec) / 1000;
+			t += (l / v->clks_msec) / 1000;
+			if (t >= i) {
+				break;
+			}
 		}
 
 		/* Only display elapsed time if flag is set */
-		if (flag == 0) {
-			continue;
-		}
-
-		if (t != ip) {
+		if (flag) {
 			do_tick(me);
-			BAILR
-			ip = t;
+			if (bail) {
+				break;
+			}
 		}
 	}
+	if (me == mstr_cpu) {
+		stat_idle(0);
+	}
 }
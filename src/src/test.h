@@ -46,6 +46,10 @@ typedef unsigned long ulong;
 
 #define SPINSZ		0x4000000	/* 64 MB */
 #define MOD_SZ		20
+#define HAM_LOOPS	0x40000		/* Reads of each row hammer pair */
+#define STRESS_SEC	60		/* Stress test time without stress= */
+#define BUDGET_MAX	65535		/* Longest budget= in minutes, the budget
+					 * is kept in msec in 32 bits */
 #define BAILOUT		if (bail) return(1);
 #define BAILR		if (bail) return;
 
@@ -60,6 +64,7 @@ typedef unsigned long ulong;
 #define LINE_PAT        5
 #define LINE_STATUS	8
 #define LINE_INFO	10
+#define LINE_ETA	11
 #define LINE_HEADER	12
 #define LINE_SCROLL	14
 #define LINE_MSG	18
@@ -85,6 +90,7 @@ typedef unsigned long ulong;
 #define CPM_ALL    1
 #define CPM_RROBIN 2
 #define CPM_SEQ    3
+#define CPM_ROTATE 4
 
 /* memspeed operations */
 #define MS_COPY		1
@@ -120,8 +126,18 @@ void hprint3(int y,int x, ulong val, int len);
 void xprint(int y,int x,ulong val);
 void aprint(int y,int x,ulong page);
 void dprint(int y,int x,ulong val,int len, int right);
-void movinv1(int iter, ulong p1, ulong p2, int cpu);
+/* movinv1() fusion: memory already holds p1, leave pn in memory */
+#define FUSE_IN		1
+#define FUSE_OUT	2
+void movinv1(int iter, ulong p1, ulong p2, int fuse, ulong pn, int cpu);
 void movinvr(int cpu);
+int addr_flush_ok(void);
+int fill_nt_ok(void);
+void fill_words(ulong *p, ulong len, ulong p1, int nt);
+int copy_ok(int e);
+char *copy_name(int e);
+int copy_engine(void);
+void copy_words(ulong *d, ulong *s, ulong len, int e);
 void movinv32(int iter, ulong p1, ulong lb, ulong mb, int sval, int off,
 	int cpu);
 void modtst(int off, int iter, ulong p1, ulong p2, int cpu);
@@ -147,7 +163,7 @@ void get_config(void);
 void get_menu(void);
 void get_printmode(void);
 void addr_tst1(int cpu);
-void addr_tst2(int cpu);
+void addr_tst2(int cpu, int split);
 void sleep(long sec, int flag, int cpu);
 void block_move(int iter, int cpu);
 void find_ticks(void);
@@ -156,6 +172,7 @@ void print_ecc_err(ulong page, ulong offset, int corrected,
 	unsigned short syndrome, int channel);
 void mem_size(void);
 void adj_mem(void);
+void compute_windows(void);
 void btrace(int me, int line, char *msg, int delay, long v1, long v2);
 ulong getval(int x, int y, int result_shift);
 int get_key(void);
@@ -169,6 +186,17 @@ void start_config(void);
 void paging_off(void);
 void show_spd(void);
 int map_page(unsigned long page);
+void pat_setup(void);
+void mtrr_audit(void);
+void mtrr_apply(void);
+void simd_setup(void);
+void simd_select(void);
+char *simd_name(int l);
+extern int simd_level;
+extern char kvar[];
+void bench_run(int me, int n, ulong start, ulong len);
+void set_memtype(int type);
+int get_memtype(void);
 void *mapping(unsigned long page_address);
 void *emapping(unsigned long page_address);
 ulong memspeed(ulong src, ulong len, int iter);
@@ -176,7 +204,45 @@ unsigned long page_of(void *ptr);
 ulong correct_tsc(ulong el_org);
 void bit_fade_fill(unsigned long n, int cpu);
 void bit_fade_chk(unsigned long n, int cpu);
+void hammer(int iter, int cpu);
+void hammer_report(void);
+void cross_cpu(int iter, int cpu);
+extern short err_writer[];
+void dram_find(ulong start, ulong len);
+unsigned long long dram_pair(volatile ulong *a, volatile ulong *b, ulong n);
+unsigned long long dram_phys(void *p);
+extern unsigned long long dram_rows;
+void stress(int cpu);
+void stress_report(void);
+ulong stress_time(void);
 void find_ticks_for_pass(void);
+int report_line(void);
+unsigned long long udiv64(unsigned long long n, ulong d);
+void pmu_setup(void);
+void pmu_start(void);
+void pmu_stop(void);
+void pmu_report(void);
+void stat_start(int me);
+void stat_stop(int me);
+void stat_mark(int iter);
+unsigned long long get_tsc(void);
+ulong stat_est_ms(int t, int c);
+ulong stat_test_ms(void);
+void stat_idle(int flag);
+int stat_eta(int *tpct, int *ppct);
+void budget_start(void);
+int budget_pass(void);
+int budget_next(void);
+int budget_after(int tst);
+int budget_iter(int tst);
+int budget_over(void);
+ulong budget_left(void);
+void budget_err(void);
+void budget_report(void);
+void fade_move(void);
+void fade_window(int me, ulong wstart, ulong wend);
+void fade_status(void);
+void stat_report(void);
 
 #define PRINTMODE_SUMMARY   0
 #define PRINTMODE_ADDRESSES 1
@@ -190,6 +256,37 @@ struct pair {
        ulong mask;
 };
 
+/* Memory types for the memory under test, see set_memtype() */
+#define MT_WB		0	/* Write back */
+#define MT_WT		1	/* Write through */
+#define MT_UC		2	/* Uncached */
+#define MT_WC		3	/* Write combining */
+
+/* Copy engines for the block move test, see copy_words() */
+#define CE_MOVSD	0	/* rep movsl */
+#define CE_MOVSB	1	/* rep movsb */
+#define CE_SSE		2	/* SSE2 loads and stores */
+#define CE_AVX		3	/* AVX loads and stores */
+#define CE_NT		4	/* SSE2 loads, non-temporal stores */
+#define CE_MAX		5
+
+/* Levels of CPU features for the test kernels, see simd.c */
+#define SL_I386		0	/* No SIMD */
+#define SL_SSE2		1
+#define SL_SSE41	2
+#define SL_AVX		3
+#define SL_AVX2		4
+#define SL_AVX512	5
+#define SL_MAX		6
+
+/* The kernels with more than one variant, kvar[] has the level of each */
+#define KV_FILL		0	/* Non-temporal fills, fill_words() */
+#define KV_CHECK	1	/* Bit fade check */
+#define KV_TILE		2	/* 32 bit shifting and modulo 20 SSE2 kernels */
+#define KV_COPY		3	/* Copy engines, copy_ok() */
+#define KV_FLUSH	4	/* Address test line flush */
+#define KV_MAX		5
+
 static inline void cache_off(void)
 {
         asm(
@@ -222,6 +319,9 @@ struct pmap {
 	ulong end;
 };
 
+/* Memory map without the background bit fade region (fade.c) */
+int fade_exclude(struct pmap *pm);
+
 struct tseq {
 	short sel;				// Boolean toggle stating wether to run the test, on by default
 	short cpu_sel;			// Number of CPUs to run this test on, -1 means every CPU seperately in order
@@ -231,6 +331,24 @@ struct tseq {
 	char *msg;				// Test description for display
 };
 
+#define MAX_TESTS	16	/* Size of the per test statistics tables */
+
+/* Number of performance counters sampled for each test (pmu.c) */
+#define PMU_NCTR	4
+
+/* Bytes read and written by each CPU, kept by the test kernels and
+ * collected after each window (stats.c) */
+struct cpu_acct {
+	unsigned long long rd;
+	unsigned long long wr;
+	ulong pad[12];
+};
+extern struct cpu_acct cpu_acct[];
+
+#define ACCT_RD(me, n)	(cpu_acct[me].rd += (ulong)(n))
+#define ACCT_WR(me, n)	(cpu_acct[me].wr += (ulong)(n))
+#define ACCT_RW(me, n)	do { ACCT_RD(me, n); ACCT_WR(me, n); } while (0)
+
 struct xadr {
 	ulong page;
 	ulong offset;
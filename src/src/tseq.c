@@ -0,0 +1,37 @@
+/* tseq.c - MemTest-86  Version 4.1
+ *
+ * The sequence of tests.  This is kept apart from main.c so the Linux
+ * build (linux.c) runs the tests in the same order.
+ *
+ * Released under version 2 of the Gnu Public License.
+ */
+#include "test.h"
+
+/*
+from test.h (for reference)
+struct tseq {
+	short sel;				// Boolean toggle stating wether to run the test, on by default
+	short cpu_sel;			// Number of CPUs to run this test on, -1 means every CPU seperately in order
+	short pat;				// Which test pattern to use for this test, see do_test() in main.c
+	short iter;				// Number of times (iterations) to repeat the test, this value is divided by 3 on first pass
+	unsigned short errors;	// Count of errors encountered in this test, initialized to 0
+	char *msg;				// Test description for display
+};
+*/
+struct tseq tseq[] = {
+	{1, -1,  0,   6, 0, "[Address test, walking ones, no cache] "}, // 0
+	{1, -1,  1,   6, 0, "[Address test, own address Sequential] "}, // 1
+	{1, 32,  2,   6, 0, "[Address test, own address Parallel]   "}, // 2
+	{1, 32,  3,   6, 0, "[Moving inversions, 1s & 0s Parallel]  "}, // 3
+	{1, 32,  5,   3, 0, "[Moving inversions, 8 bit pattern]     "}, // 4
+	{1, 32,  6,  30, 0, "[Moving inversions, random pattern]    "}, // 5
+	{1, 32,  7,  81, 0, "[Block move]                           "}, // 6
+	{1, 32,  8,   3, 0, "[Moving inversions, 32 bit pattern]    "}, // 7
+	{1, 32,  9,  24, 0, "[Random number sequence]               "}, // 8
+    {1, 32, 10,   6, 0, "[Modulo 20, Random pattern]            "}, // 9
+	{1, 32, 11, 240, 0, "[Bit fade test, 2 patterns]            "}, // 10
+	{1, 32, 12,  12, 0, "[Row hammer, cache flush]              "}, // 11
+	{0, 32, 13,   3, 0, "[Stress, block copy + checksum]        "}, // 12
+	{1, 32, 14,   3, 0, "[Cross CPU write and check]            "}, // 13
+	{1, 0,   0,   0, 0, NULL}
+};
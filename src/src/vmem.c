@@ -8,10 +8,62 @@
 #include "stdint.h"
 #include "test.h"
 #include "cpuid.h"
+#include "msr.h"
 
 extern struct cpu_ident cpu_id;
+extern volatile int segs;
 
 static unsigned long mapped_win = 1;
+static int mem_type = MT_WB;
+
+/* PWT, PCD and PAT bits of a 2 MB page for each memory type.  PAT entry
+ * 4 is set to write combining by pat_setup(), 0 - 3 are left at the
+ * power on WB, WT, UC-, UC. */
+static const unsigned long pde_type[] = {
+	0x0000,		/* MT_WB, PAT entry 0 */
+	0x0008,		/* MT_WT, PAT entry 1 */
+	0x0018,		/* MT_UC, PAT entry 3 */
+	0x1000,		/* MT_WC, PAT entry 4 */
+};
+
+/*
+ * Make PAT entry 4 write combining.  The PAT is per CPU so each CPU
+ * has to do this.
+ */
+void pat_setup(void)
+{
+	unsigned long lo, hi;
+
+	if (!cpu_id.fid.bits.pat) {
+		return;
+	}
+	rdmsr(MSR_IA32_CR_PAT, lo, hi);
+	hi = (hi & ~0xff) | 0x01;
+	asm __volatile__ ("wbinvd");
+	wrmsr(MSR_IA32_CR_PAT, lo, hi);
+	asm __volatile__ ("wbinvd");
+}
+
+/*
+ * Set the memory type for the memory under test, used by the next
+ * map_page().  Called by the master CPU after the segments are known.
+ */
+void set_memtype(int type)
+{
+	if (!cpu_id.fid.bits.pae) {
+		type = MT_WB;
+	}
+	if (type == MT_WC && !cpu_id.fid.bits.pat) {
+		type = MT_UC;
+	}
+	mem_type = type;
+}
+
+int get_memtype(void)
+{
+	return mem_type;
+}
+
 void paging_off(void)
 {
 	if (!cpu_id.fid.bits.pae)
@@ -60,20 +112,48 @@ static void paging_on_lm(void *pml)
 		);
 }
 
+struct pde {
+	unsigned long addr_lo;
+	unsigned long addr_hi;
+};
+
+/*
+ * The memory type bits for the 2 MB page at virtual address i << 21.
+ * Only pages that are completely inside the segments being tested get
+ * the memory type.  The first 2 MB and the pages with the program stay
+ * write back, this keeps the code, the barrier and the page tables
+ * cached.
+ */
+static unsigned long pde_bits(unsigned long i)
+{
+	unsigned long first, last;
+	int j;
+
+	if (mem_type == MT_WB || i == 0 || (i >= (unsigned long)_start >> 21 &&
+			i <= ((unsigned long)_end - 1) >> 21)) {
+		return 0;
+	}
+	for (j = 0; j < segs; j++) {
+		first = ((unsigned long)v->map[j].start + 0x1fffff) >> 21;
+		last = (((unsigned long)v->map[j].end >> 2) + 1) >> 19;
+		if (i >= first && i < last) {
+			return pde_type[mem_type];
+		}
+	}
+	return 0;
+}
+
 int map_page(unsigned long page)
 {
 	unsigned long i;
-	struct pde {
-		unsigned long addr_lo;
-		unsigned long addr_hi;
-	};
 	extern unsigned char pdp[];
 	extern unsigned char pml4[];
-	extern struct pde pd2[];
+	extern struct pde pd0[], pd2[];
 	unsigned long win = page >> 19;
 
-	/* Less than 2 GB so no mapping is required */
-	if (win == 0) {
+	/* Less than 2 GB so no mapping is required, unless the memory
+	 * type is set.  Then paging is used with the identity map. */
+	if (win == 0 && (mem_type == MT_WB || cpu_id.fid.bits.pae == 0)) {
 		return 0;
 	}
 	if (cpu_id.fid.bits.pae == 0) {
@@ -87,7 +167,7 @@ int map_page(unsigned long page)
 		return -1;
 	}
 	/* Compute the page table entries... */
-	for(i = 0; i < 1024; i++) {
+	for(i = 0; i < 1024 && win != 0; i++) {
 		/*-----------------10/30/2004 12:37PM---------------
 		 * 0xE3 --
 		 * Bit 0 = Present bit.      1 = PDE is present
@@ -99,9 +179,22 @@ int map_page(unsigned long page)
 		 * Bit 6 = Dirty.            1 = memory has been written to.
 		 * Bit 7 = Page Size.        1 = page size is 2 MBytes
 		 * --------------------------------------------------*/
-		pd2[i].addr_lo = ((win & 1) << 31) + ((i & 0x3ff) << 21) + 0xE3;
+		pd2[i].addr_lo = ((win & 1) << 31) + ((i & 0x3ff) << 21) + 0xE3 +
+			pde_bits(1024 + i);
 		pd2[i].addr_hi = (win >> 1);
 	}
+
+	/* The identity map of the first 2 GB.  Every CPU does this so each
+	 * entry is only written once, with its final value. */
+	for (i = 1; i < 1024; i++) {
+		pd0[i].addr_lo = (pd0[i].addr_lo &
+			~(pde_type[MT_UC] | pde_type[MT_WC])) | pde_bits(i);
+	}
+
+	/* Nothing from the memory under test may be left in the cache */
+	if (mem_type != MT_WB) {
+		asm __volatile__ ("wbinvd");
+	}
 	paging_off();
 	if (cpu_id.fid.bits.lm == 1) {
 		paging_on_lm(pml4);